@@ -0,0 +1,222 @@
+/*
+ * thp-tlb: TLB miss cost with and without transparent huge pages
+ *
+ * Maps a large anonymous buffer, faults it in, and follows a random
+ * cyclic chain of pointers through it, one pointer per 4k page, so that
+ * nearly every load misses the TLB.  The run is repeated with
+ * /sys/kernel/mm/transparent_hugepage/enabled set to "never" and to
+ * "always", and the average time per load is printed for both, along
+ * with how much of the buffer the kernel actually mapped huge.
+ *
+ * Build:  gcc -O2 -o thp-tlb thp-tlb.c
+ * Usage:  thp-tlb [-m megabytes] [-n loads] [-t always|never|both]
+ *
+ * Switching the sysfs knob needs root; the setting found at start is
+ * restored at exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define THP_ENABLED	"/sys/kernel/mm/transparent_hugepage/enabled"
+#define HPAGE_SIZE	(2UL << 20)
+#define PAGE_SIZE	4096UL
+
+static size_t buf_mb = 1024;
+static unsigned long nr_loads = 20000000;
+static char saved_mode[32];
+static void *volatile sink;	/* keeps the pointer chase from being elided */
+
+static int thp_read_mode(char *mode, size_t len)
+{
+	char buf[128], *p, *q;
+	FILE *f = fopen(THP_ENABLED, "r");
+
+	if (!f)
+		return -1;
+	if (!fgets(buf, sizeof(buf), f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	/* "[always] never", or "always [madvise] never" on later kernels */
+	p = strchr(buf, '[');
+	q = p ? strchr(p, ']') : NULL;
+	if (!p || !q || (size_t)(q - p) > len)
+		return -1;
+	*q = '\0';
+	strcpy(mode, p + 1);
+	return 0;
+}
+
+static int thp_set_mode(const char *mode)
+{
+	FILE *f = fopen(THP_ENABLED, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fputs(mode, f) < 0;
+	if (fclose(f))
+		ret = 1;
+	return ret ? -1 : 0;
+}
+
+/* kB of the mapping at @addr backed by huge pages, -1 if unknown */
+static long anon_huge_kb(void *addr)
+{
+	char line[256];
+	unsigned long start, end;
+	int in_vma = 0;
+	long kb = -1;
+	FILE *f = fopen("/proc/self/smaps", "r");
+
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			in_vma = (unsigned long)addr >= start &&
+				 (unsigned long)addr < end;
+			continue;
+		}
+		if (in_vma && sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(const char *mode)
+{
+	size_t size = buf_mb << 20, npages = size / PAGE_SIZE, i;
+	size_t *order;
+	char *map, *buf;
+	void **p;
+	double start, elapsed;
+	unsigned long n;
+	long huge_kb;
+
+	if (thp_set_mode(mode)) {
+		fprintf(stderr, "cannot write %s to " THP_ENABLED "\n", mode);
+		return -1;
+	}
+
+	/* align the buffer so that every 2M extent of it can go huge */
+	map = mmap(NULL, size + HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	buf = (char *)(((uintptr_t)map + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1));
+
+	/* random cyclic order of the pages, at a random offset in each */
+	order = malloc(npages * sizeof(*order));
+	if (!order) {
+		perror("malloc");
+		munmap(map, size + HPAGE_SIZE);
+		return -1;
+	}
+	for (i = 0; i < npages; i++)
+		order[i] = i;
+	for (i = npages - 1; i > 0; i--) {
+		size_t j = random() % (i + 1), tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (i = 0; i < npages; i++) {
+		size_t off = (random() % (PAGE_SIZE / 64)) * 64;
+
+		order[i] = order[i] * PAGE_SIZE + off;
+	}
+	for (i = 0; i < npages; i++)
+		*(void **)(buf + order[i]) = buf + order[(i + 1) % npages];
+	p = (void **)(buf + order[0]);
+	free(order);
+
+	huge_kb = anon_huge_kb(buf);
+
+	start = now();
+	for (n = 0; n < nr_loads; n++)
+		p = *p;
+	elapsed = now() - start;
+	sink = p;
+
+	printf("thp %-6s: %zu MB, %lu loads, %.2f ns/load",
+	       mode, buf_mb, nr_loads,
+	       elapsed * 1e9 / nr_loads);
+	if (huge_kb >= 0)
+		printf(", %ld MB mapped huge", huge_kb >> 10);
+	printf("\n");
+
+	munmap(map, size + HPAGE_SIZE);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m megabytes] [-n loads] [-t always|never|both]\n"
+		"  -m megabytes  buffer size (default: 1024)\n"
+		"  -n loads      pointer loads per run (default: 20000000)\n"
+		"  -t mode       THP setting to run with (default: both)\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mode = "both";
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "m:n:t:h")) != -1) {
+		switch (c) {
+		case 'm':
+			buf_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_loads = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			mode = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!buf_mb || !nr_loads ||
+	    (strcmp(mode, "both") && strcmp(mode, "always") &&
+	     strcmp(mode, "never")))
+		usage(argv[0]);
+
+	if (thp_read_mode(saved_mode, sizeof(saved_mode))) {
+		fprintf(stderr, "cannot read " THP_ENABLED "\n");
+		return 1;
+	}
+
+	srandom(time(NULL));
+	if (!strcmp(mode, "both")) {
+		if (run("never") || run("always"))
+			ret = 1;
+	} else if (run(mode))
+		ret = 1;
+
+	thp_set_mode(saved_mode);
+	return ret;
+}
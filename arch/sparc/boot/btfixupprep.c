@@ -31,6 +31,7 @@
 
 static char *symtab = "SYMBOL TABLE:";
 static char *relrec = "RELOCATION RECORDS FOR [";
+static char *ksymsect = "___ksymtab+";
 static int rellen;
 static int symlen;
 int mode;
@@ -54,7 +55,18 @@ typedef struct _btfixup {
 	btfixuprel *rel;
 } btfixup;
 
+/* Each EXPORT_SYMBOL lives in its own ___ksymtab+<sym> section, which
+   the linker script merges into __ksymtab sorted by name.  */
+typedef struct _ksymtab {
+	char *name;
+	unsigned long size;
+	unsigned long align;
+	unsigned long offset;
+} ksymtab;
+
 btfixup array[MAXSYMS];
+ksymtab *ksyms;
+int nksyms = 0;
 int last = 0;
 char buffer[1024];
 unsigned long lastfoffset = -1;
@@ -88,6 +100,70 @@ btfixup *find(int type, char *name)
 	return array + last - 1;
 }
 
+void add_ksymtab (char *buffer)
+{
+	static int maxksyms;
+	char name[256];
+	unsigned long size;
+	int idx, align;
+
+	if (sscanf (buffer, "%d %255s %lx %*s %*s %*s 2**%d",
+		    &idx, name, &size, &align) != 4)
+		return;
+	if (strncmp (name, ksymsect, strlen (ksymsect)))
+		return;
+	if (nksyms == maxksyms) {
+		maxksyms = maxksyms ? maxksyms * 2 : 1024;
+		ksyms = realloc (ksyms, maxksyms * sizeof(ksymtab));
+		if (!ksyms) fatal();
+	}
+	ksyms[nksyms].name = strdup(name);
+	if (!ksyms[nksyms].name) fatal();
+	ksyms[nksyms].size = size;
+	ksyms[nksyms].align = 1UL << align;
+	nksyms++;
+}
+
+int ksymtab_cmp (const void *a, const void *b)
+{
+	return strcmp (((const ksymtab *)a)->name, ((const ksymtab *)b)->name);
+}
+
+/* Lay the ___ksymtab+ sections out the way SORT() in the linker
+   script does, so that their relocations can be expressed relative
+   to __start___ksymtab.  */
+void layout_ksymtab (void)
+{
+	unsigned long offset = 0;
+	int i;
+
+	qsort (ksyms, nksyms, sizeof(ksymtab), ksymtab_cmp);
+	for (i = 0; i < nksyms; i++) {
+		offset = (offset + ksyms[i].align - 1) & ~(ksyms[i].align - 1);
+		ksyms[i].offset = offset;
+		offset += ksyms[i].size;
+	}
+}
+
+unsigned long ksymtab_offset (char *sect)
+{
+	ksymtab key, *k;
+
+	/* Already merged into __ksymtab by the vmlinux link */
+	if (!strcmp (sect, "__ksymtab"))
+		return 0;
+	key.name = sect;
+	k = bsearch (&key, ksyms, nksyms, sizeof(ksymtab), ksymtab_cmp);
+	if (!k) fatal();
+	return k->offset;
+}
+
+int is_ksymtab (char *sect)
+{
+	return !strcmp (sect, "__ksymtab") ||
+	       !strncmp (sect, ksymsect, strlen (ksymsect));
+}
+
 void set_mode (char *buffer)
 {
   	for (mode = 0;; mode++)
@@ -111,11 +187,14 @@ int main(int argc,char **argv)
 	char *initvalstr;
 
 	symlen = strlen(symtab);
-	while (fgets (buffer, 1024, stdin) != NULL)
+	while (fgets (buffer, 1024, stdin) != NULL) {
 		if (!strncmp (buffer, symtab, symlen))
 			goto main0;
+		add_ksymtab (buffer);
+	}
 	fatal();
 main0:
+	layout_ksymtab ();
 	rellen = strlen(relrec);
 	while (fgets (buffer, 1024, stdin) != NULL)
 		if (!strncmp (buffer, relrec, rellen))
@@ -176,7 +255,7 @@ main1:
 		if (strcmp (sect, ".text") &&
 		    strcmp (sect, ".init.text") &&
 		    strcmp (sect, ".fixup") &&
-		    (strcmp (sect, "__ksymtab") || buffer[nbase+3] != 'f')) {
+		    (!is_ksymtab (sect) || buffer[nbase+3] != 'f')) {
 			if (buffer[nbase+3] == 'f')
 				fprintf(stderr,
 				    "Wrong use of '%s' in '%s' section.\n"
@@ -219,7 +298,7 @@ main1:
 				fprintf(stderr, "Cannot use pre-initalized fixups for calls\n%s\n", buffer);
 				exit(1);
 			}
-			if (!strcmp (sect, "__ksymtab")) {
+			if (is_ksymtab (sect)) {
 				if (strncmp (buffer + mode+9, "32        ", 10)) {
 					fprintf(stderr, "BTFIXUP_CALL in EXPORT_SYMBOL results in relocation other than R_SPARC_32\n\%s\n", buffer);
 					exit(1);
@@ -344,8 +423,9 @@ main1:
 				printf ("_stext+0x%08lx", r->offset);
 			else if (!strcmp (r->sect, ".init.text"))
 				printf ("__init_begin+0x%08lx", r->offset);
-			else if (!strcmp (r->sect, "__ksymtab"))
-				printf ("__start___ksymtab+0x%08lx", r->offset);
+			else if (is_ksymtab (r->sect))
+				printf ("__start___ksymtab+0x%08lx",
+					ksymtab_offset (r->sect) + r->offset);
 			else if (!strcmp (r->sect, ".fixup"))
 				printf ("__start___fixup+0x%08lx", r->offset);
 			else
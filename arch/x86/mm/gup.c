@@ -124,6 +124,12 @@ static noinline int gup_huge_pmd(pmd_t pmd, unsigned long addr,
 
 	refs = 0;
 	head = pte_page(pte);
+	/*
+	 * Transparent huge pages are not pinned through the head page:
+	 * the slow path splits them before taking references.
+	 */
+	if (PageAnon(head))
+		return 0;
 	page = head + ((addr & ~PMD_MASK) >> PAGE_SHIFT);
 	do {
 		VM_BUG_ON(compound_head(page) != head);
@@ -148,9 +154,16 @@ static int gup_pmd_range(pud_t pud, unsigned long addr, unsigned long end,
 		pmd_t pmd = *pmdp;
 
 		next = pmd_addr_end(addr, end);
-		if (pmd_none(pmd))
+		/*
+		 * pmdp_splitting_flush() cannot complete its TLB flush
+		 * while we run with interrupts disabled, but a pmd already
+		 * marked splitting is on its way to become a pte table:
+		 * leave it to the slow path.
+		 */
+		if (pmd_none(pmd) || pmd_trans_splitting(pmd))
 			return 0;
-		if (unlikely(pmd_large(pmd))) {
+		/* hugetlbfs and transparent huge pmds map the same way */
+		if (unlikely(pmd_large(pmd) || pmd_trans_huge(pmd))) {
 			if (!gup_huge_pmd(pmd, addr, next, write, pages, nr))
 				return 0;
 		} else {
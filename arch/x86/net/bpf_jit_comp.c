@@ -0,0 +1,485 @@
+/* bpf_jit_comp.c : BPF JIT compiler
+ *
+ * Compiles classic BPF socket filters (already validated by
+ * sk_chk_filter()) into x86-64 code.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+#include <linux/moduleloader.h>
+#include <asm/cacheflush.h>
+#include <linux/netdevice.h>
+#include <linux/filter.h>
+#include <linux/workqueue.h>
+#include <linux/slab.h>
+
+/*
+ * Conventions :
+ *  EAX : BPF A accumulator
+ *  EBX : BPF X register
+ *  RDI : pointer to skb   (first argument given to JIT function)
+ *  R8  : copy of skb->data
+ *  R9d : skb->len - skb->data_len (headlen)
+ *
+ * Stack frame (below the saved RBP) :
+ *  -8  : saved RBX
+ *  -12 : scratch word for the load slow paths
+ *  -16 : scratch word for the load slow paths
+ *  -80 : BPF scratch memory M[0] .. M[15] (up to -20)
+ */
+int bpf_jit_enable __read_mostly;
+
+/* Packet load helpers, see bpf_jit.S */
+extern u8 sk_load_word[], sk_load_half[], sk_load_byte[], sk_load_byte_msh[];
+extern u8 sk_load_word_ind[], sk_load_half_ind[], sk_load_byte_ind[];
+
+#define BPF_FRAME_SIZE	96
+#define SCRATCH_OFF(k)	(-80 + 4 * (k))
+
+/* Upper bound of the code emitted for any single BPF instruction */
+#define BPF_MAX_INSN_SIZE	64
+#define BPF_MAX_PASSES		10
+
+static inline u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
+{
+	if (len == 1)
+		*ptr = bytes;
+	else if (len == 2)
+		*(u16 *)ptr = bytes;
+	else {
+		*(u32 *)ptr = bytes;
+		barrier();
+	}
+	return ptr + len;
+}
+
+#define EMIT(bytes, len)	do { prog = emit_code(prog, bytes, len); } while (0)
+
+#define B(b)			((u32)(b) & 0xff)
+#define EMIT1(b1)		EMIT(B(b1), 1)
+#define EMIT2(b1, b2)		EMIT(B(b1) | B(b2) << 8, 2)
+#define EMIT3(b1, b2, b3)	EMIT(B(b1) | B(b2) << 8 | B(b3) << 16, 3)
+#define EMIT4(b1, b2, b3, b4)	EMIT(B(b1) | B(b2) << 8 | B(b3) << 16 | B(b4) << 24, 4)
+#define EMIT1_off32(b1, off)	do { EMIT1(b1); EMIT(off, 4); } while (0)
+
+#define CLEAR_A()	EMIT2(0x31, 0xc0)	/* xor %eax,%eax */
+#define CLEAR_X()	EMIT2(0x31, 0xdb)	/* xor %ebx,%ebx */
+
+static inline bool is_imm8(int value)
+{
+	return value <= 127 && value >= -128;
+}
+
+/* "op off(%rdi),reg" with the shortest displacement, modrm_reg = reg << 3 */
+#define EMIT_SKB_FIELD(rex, opcode, modrm_reg, off)			\
+do {									\
+	if (rex)							\
+		EMIT1(rex);						\
+	if (is_imm8(off)) {						\
+		EMIT3(opcode, 0x47 | (modrm_reg), off);			\
+	} else {							\
+		EMIT2(opcode, 0x87 | (modrm_reg));			\
+		EMIT(off, 4);						\
+	}								\
+} while (0)
+
+/* x86 conditional jump opcodes (. + s8), 0x0f 0x80+cc for (. + s32) */
+#define X86_JB  0x72
+#define X86_JAE 0x73
+#define X86_JE  0x74
+#define X86_JNE 0x75
+#define X86_JBE 0x76
+#define X86_JA  0x77
+
+/* Current position in the image, as estimated by the previous pass */
+#define POS()	(addrs[i] + (prog - temp))
+
+/* jmp from the current position to image offset target */
+#define EMIT_JMP(target)						\
+do {									\
+	int __off = (target) - (POS() + 2);				\
+	if (is_imm8(__off))						\
+		EMIT2(0xeb, __off);		/* jmp .+off8 */	\
+	else								\
+		EMIT1_off32(0xe9, (target) - (POS() + 5)); /* jmp .+off32 */ \
+} while (0)
+
+#define EMIT_COND_JMP(op, target)					\
+do {									\
+	int __off = (target) - (POS() + 2);				\
+	if (is_imm8(__off))						\
+		EMIT2(op, __off);		/* jxx .+off8 */	\
+	else {								\
+		__off = (target) - (POS() + 6);				\
+		EMIT2(0x0f, (op) + 0x10);	/* jxx .+off32 */	\
+		EMIT(__off, 4);						\
+	}								\
+} while (0)
+
+/* call a packet load helper */
+#define EMIT_CALL(func)							\
+	EMIT1_off32(0xe8, (u8 *)(func) - (image + POS() + 5))
+
+#define COND_SEL(CODE, TOP, FOP)	\
+	case CODE:			\
+		t_op = TOP;		\
+		f_op = FOP;		\
+		goto cond_branch
+
+/*
+ * The image is freed from a work item, since sk_filter_release() can run
+ * from an RCU callback and vfree() must not be called in softirq context.
+ * The work_struct lives in the (no longer used) image itself.
+ */
+static void jit_free_defer(struct work_struct *arg)
+{
+	module_free(NULL, arg);
+}
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	u8 temp[BPF_MAX_INSN_SIZE];
+	u8 *prog;
+	unsigned int proglen, oldproglen = 0;
+	int ilen, i, pass;
+	u8 t_op, f_op;
+	u8 *image = NULL;
+	int *addrs;
+	const struct sock_filter *filter = fp->insns;
+	int flen = fp->len;
+	bool changed;
+
+	if (!bpf_jit_enable)
+		return;
+
+	/*
+	 * addrs[i] is the offset in the image of the code for instruction i,
+	 * addrs[flen] the offset of the epilogue.  Start with a generous
+	 * estimation, each pass then shrinks the image until it converges.
+	 */
+	addrs = kmalloc((flen + 1) * sizeof(*addrs), GFP_KERNEL);
+	if (addrs == NULL)
+		return;
+	for (i = 0; i <= flen; i++)
+		addrs[i] = (i + 1) * BPF_MAX_INSN_SIZE;
+
+	for (pass = 0; pass < BPF_MAX_PASSES; pass++) {
+		changed = false;
+
+		/* prologue */
+		prog = temp;
+		EMIT1(0x55);			/* push %rbp */
+		EMIT3(0x48, 0x89, 0xe5);	/* mov %rsp,%rbp */
+		EMIT4(0x48, 0x83, 0xec, BPF_FRAME_SIZE); /* sub $96,%rsp */
+		EMIT4(0x48, 0x89, 0x5d, 0xf8);	/* mov %rbx,-8(%rbp) */
+		CLEAR_A();
+		CLEAR_X();
+		/* mov off(%rdi),%r9d */
+		EMIT_SKB_FIELD(0x44, 0x8b, 1 << 3,
+			       offsetof(struct sk_buff, len));
+		/* sub off(%rdi),%r9d */
+		EMIT_SKB_FIELD(0x44, 0x2b, 1 << 3,
+			       offsetof(struct sk_buff, data_len));
+		/* mov off(%rdi),%r8 */
+		EMIT_SKB_FIELD(0x4c, 0x8b, 0,
+			       offsetof(struct sk_buff, data));
+		proglen = prog - temp;
+		if (image)
+			memcpy(image, temp, proglen);
+
+		for (i = 0; i < flen; i++) {
+			unsigned int K = filter[i].k;
+
+			if (addrs[i] != proglen)
+				changed = true;
+			addrs[i] = proglen;
+			prog = temp;
+
+			switch (filter[i].code) {
+			case BPF_ALU|BPF_ADD|BPF_X:	/* A += X; */
+				EMIT2(0x01, 0xd8);	/* add %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_ADD|BPF_K:	/* A += K; */
+				if (!K)
+					break;
+				if (is_imm8(K))
+					EMIT3(0x83, 0xc0, K);	/* add imm8,%eax */
+				else
+					EMIT1_off32(0x05, K);	/* add imm32,%eax */
+				break;
+			case BPF_ALU|BPF_SUB|BPF_X:	/* A -= X; */
+				EMIT2(0x29, 0xd8);	/* sub %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_SUB|BPF_K:	/* A -= K */
+				if (!K)
+					break;
+				if (is_imm8(K))
+					EMIT3(0x83, 0xe8, K);	/* sub imm8,%eax */
+				else
+					EMIT1_off32(0x2d, K);	/* sub imm32,%eax */
+				break;
+			case BPF_ALU|BPF_MUL|BPF_X:	/* A *= X; */
+				EMIT3(0x0f, 0xaf, 0xc3);	/* imul %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_MUL|BPF_K:	/* A *= K */
+				if (is_imm8(K))
+					EMIT3(0x6b, 0xc0, K);	/* imul imm8,%eax,%eax */
+				else {
+					EMIT2(0x69, 0xc0);	/* imul imm32,%eax,%eax */
+					EMIT(K, 4);
+				}
+				break;
+			case BPF_ALU|BPF_DIV|BPF_X: {	/* A /= X; */
+				int jlen;
+
+				/* if (X == 0) return 0; */
+				EMIT2(0x85, 0xdb);	/* test %ebx,%ebx */
+				jlen = is_imm8(addrs[flen] - (POS() + 6)) ?
+					2 : 5;
+				EMIT2(X86_JNE, 2 + jlen);
+				CLEAR_A();
+				EMIT_JMP(addrs[flen]);
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT2(0xf7, 0xf3);	/* div %ebx */
+				break;
+			}
+			case BPF_ALU|BPF_DIV|BPF_K:	/* A /= K */
+				EMIT1_off32(0xb9, K);	/* mov imm32,%ecx */
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT2(0xf7, 0xf1);	/* div %ecx */
+				break;
+			case BPF_ALU|BPF_AND|BPF_X:
+				EMIT2(0x21, 0xd8);	/* and %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_AND|BPF_K:
+				if (is_imm8(K))
+					EMIT3(0x83, 0xe0, K);	/* and imm8,%eax */
+				else
+					EMIT1_off32(0x25, K);	/* and imm32,%eax */
+				break;
+			case BPF_ALU|BPF_OR|BPF_X:
+				EMIT2(0x09, 0xd8);	/* or %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_OR|BPF_K:
+				if (is_imm8(K))
+					EMIT3(0x83, 0xc8, K);	/* or imm8,%eax */
+				else
+					EMIT1_off32(0x0d, K);	/* or imm32,%eax */
+				break;
+			case BPF_ALU|BPF_LSH|BPF_X:	/* A <<= X; */
+				EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				EMIT2(0xd3, 0xe0);	/* shl %cl,%eax */
+				break;
+			case BPF_ALU|BPF_LSH|BPF_K:
+				/* the CPU masks the count like it does for
+				 * the interpreter's shl %cl */
+				EMIT3(0xc1, 0xe0, K);	/* shl imm8,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_X:	/* A >>= X; */
+				EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				EMIT2(0xd3, 0xe8);	/* shr %cl,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_K:
+				EMIT3(0xc1, 0xe8, K);	/* shr imm8,%eax */
+				break;
+			case BPF_ALU|BPF_NEG:
+				EMIT2(0xf7, 0xd8);	/* neg %eax */
+				break;
+			case BPF_RET|BPF_K:
+				if (!K)
+					CLEAR_A();
+				else
+					EMIT1_off32(0xb8, K);	/* mov imm32,%eax */
+				/* fallinto */
+			case BPF_RET|BPF_A:
+				if (i != flen - 1)
+					EMIT_JMP(addrs[flen]);
+				break;
+			case BPF_MISC|BPF_TAX:	/* X = A */
+				EMIT2(0x89, 0xc3);	/* mov %eax,%ebx */
+				break;
+			case BPF_MISC|BPF_TXA:	/* A = X */
+				EMIT2(0x89, 0xd8);	/* mov %ebx,%eax */
+				break;
+			case BPF_LD|BPF_IMM:	/* A = K */
+				if (!K)
+					CLEAR_A();
+				else
+					EMIT1_off32(0xb8, K);	/* mov imm32,%eax */
+				break;
+			case BPF_LDX|BPF_IMM:	/* X = K */
+				if (!K)
+					CLEAR_X();
+				else
+					EMIT1_off32(0xbb, K);	/* mov imm32,%ebx */
+				break;
+			case BPF_LD|BPF_MEM:	/* A = mem[K] */
+				EMIT3(0x8b, 0x45, SCRATCH_OFF(K)); /* mov off8(%rbp),%eax */
+				break;
+			case BPF_LDX|BPF_MEM:	/* X = mem[K] */
+				EMIT3(0x8b, 0x5d, SCRATCH_OFF(K)); /* mov off8(%rbp),%ebx */
+				break;
+			case BPF_ST:	/* mem[K] = A */
+				EMIT3(0x89, 0x45, SCRATCH_OFF(K)); /* mov %eax,off8(%rbp) */
+				break;
+			case BPF_STX:	/* mem[K] = X */
+				EMIT3(0x89, 0x5d, SCRATCH_OFF(K)); /* mov %ebx,off8(%rbp) */
+				break;
+			case BPF_LD|BPF_W|BPF_LEN:	/* A = skb->len; */
+				EMIT_SKB_FIELD(0, 0x8b, 0 << 3,
+					       offsetof(struct sk_buff, len));
+				break;
+			case BPF_LDX|BPF_W|BPF_LEN:	/* X = skb->len; */
+				EMIT_SKB_FIELD(0, 0x8b, 3 << 3,
+					       offsetof(struct sk_buff, len));
+				break;
+			case BPF_LD|BPF_W|BPF_ABS:
+				EMIT1_off32(0xbe, K);	/* mov imm32,%esi */
+				EMIT_CALL(sk_load_word);
+				break;
+			case BPF_LD|BPF_H|BPF_ABS:
+				EMIT1_off32(0xbe, K);
+				EMIT_CALL(sk_load_half);
+				break;
+			case BPF_LD|BPF_B|BPF_ABS:
+				EMIT1_off32(0xbe, K);
+				EMIT_CALL(sk_load_byte);
+				break;
+			case BPF_LDX|BPF_B|BPF_MSH:
+				EMIT1_off32(0xbe, K);
+				EMIT_CALL(sk_load_byte_msh);
+				break;
+			case BPF_LD|BPF_W|BPF_IND:
+				EMIT1_off32(0xbe, K);
+				EMIT_CALL(sk_load_word_ind);
+				break;
+			case BPF_LD|BPF_H|BPF_IND:
+				EMIT1_off32(0xbe, K);
+				EMIT_CALL(sk_load_half_ind);
+				break;
+			case BPF_LD|BPF_B|BPF_IND:
+				EMIT1_off32(0xbe, K);
+				EMIT_CALL(sk_load_byte_ind);
+				break;
+			case BPF_JMP|BPF_JA:
+				if (K)
+					EMIT_JMP(addrs[i + 1 + K]);
+				break;
+			COND_SEL(BPF_JMP|BPF_JGT|BPF_K, X86_JA, X86_JBE);
+			COND_SEL(BPF_JMP|BPF_JGE|BPF_K, X86_JAE, X86_JB);
+			COND_SEL(BPF_JMP|BPF_JEQ|BPF_K, X86_JE, X86_JNE);
+			COND_SEL(BPF_JMP|BPF_JSET|BPF_K, X86_JNE, X86_JE);
+			COND_SEL(BPF_JMP|BPF_JGT|BPF_X, X86_JA, X86_JBE);
+			COND_SEL(BPF_JMP|BPF_JGE|BPF_X, X86_JAE, X86_JB);
+			COND_SEL(BPF_JMP|BPF_JEQ|BPF_X, X86_JE, X86_JNE);
+			COND_SEL(BPF_JMP|BPF_JSET|BPF_X, X86_JNE, X86_JE);
+
+cond_branch:
+				switch (filter[i].code) {
+				case BPF_JMP|BPF_JGT|BPF_X:
+				case BPF_JMP|BPF_JGE|BPF_X:
+				case BPF_JMP|BPF_JEQ|BPF_X:
+					EMIT2(0x39, 0xd8);	/* cmp %ebx,%eax */
+					break;
+				case BPF_JMP|BPF_JSET|BPF_X:
+					EMIT2(0x85, 0xd8);	/* test %ebx,%eax */
+					break;
+				case BPF_JMP|BPF_JEQ|BPF_K:
+				case BPF_JMP|BPF_JGT|BPF_K:
+				case BPF_JMP|BPF_JGE|BPF_K:
+					if (is_imm8(K))
+						EMIT3(0x83, 0xf8, K); /* cmp imm8,%eax */
+					else
+						EMIT1_off32(0x3d, K); /* cmp imm32,%eax */
+					break;
+				case BPF_JMP|BPF_JSET|BPF_K:
+					if (K <= 0xFF)
+						EMIT2(0xa8, K); /* test imm8,%al */
+					else
+						EMIT1_off32(0xa9, K); /* test imm32,%eax */
+					break;
+				}
+
+				if (filter[i].jt == filter[i].jf) {
+					/* both targets are the same */
+					if (filter[i].jt)
+						EMIT_JMP(addrs[i + 1 + filter[i].jt]);
+				} else if (filter[i].jt == 0) {
+					EMIT_COND_JMP(f_op,
+						      addrs[i + 1 + filter[i].jf]);
+				} else {
+					EMIT_COND_JMP(t_op,
+						      addrs[i + 1 + filter[i].jt]);
+					if (filter[i].jf)
+						EMIT_JMP(addrs[i + 1 + filter[i].jf]);
+				}
+				break;
+			default:
+				/* sk_chk_filter() let something unknown through */
+				goto out;
+			}
+
+			ilen = prog - temp;
+			if (image) {
+				if (unlikely(proglen + ilen > oldproglen)) {
+					pr_err("bpf_jit_compile fatal error\n");
+					module_free(NULL, image);
+					goto out;
+				}
+				memcpy(image + proglen, temp, ilen);
+			}
+			proglen += ilen;
+		}
+
+		/* epilogue */
+		if (addrs[flen] != proglen)
+			changed = true;
+		addrs[flen] = proglen;
+		prog = temp;
+		EMIT4(0x48, 0x8b, 0x5d, 0xf8);	/* mov -8(%rbp),%rbx */
+		EMIT1(0xc9);			/* leaveq */
+		EMIT1(0xc3);			/* ret */
+		ilen = prog - temp;
+		if (image)
+			memcpy(image + proglen, temp, ilen);
+		proglen += ilen;
+
+		if (image)
+			break;
+		/*
+		 * No instruction moved in this pass, so the next pass will
+		 * produce exactly the same code: emit it into the image.
+		 */
+		if (!changed) {
+			image = module_alloc(max_t(unsigned int, proglen,
+						   sizeof(struct work_struct)));
+			if (!image)
+				goto out;
+		}
+		oldproglen = proglen;
+	}
+
+	if (image) {
+		if (bpf_jit_enable > 1)
+			print_hex_dump(KERN_ERR, "JIT code: ", DUMP_PREFIX_ADDRESS,
+				       16, 1, image, proglen, false);
+
+		flush_icache_range((unsigned long)image,
+				   (unsigned long)image + proglen);
+		fp->bpf_func = (void *)image;
+	}
+out:
+	kfree(addrs);
+}
+
+void bpf_jit_free(struct sk_filter *fp)
+{
+	if (fp->bpf_func) {
+		struct work_struct *work = (struct work_struct *)fp->bpf_func;
+
+		INIT_WORK(work, jit_free_defer);
+		schedule_work(work);
+	}
+}
@@ -0,0 +1,596 @@
+/*
+ * Compressed RAM block device
+ *
+ * Every page written to a zram device is compressed with LZO and kept in
+ * memory; pages that are entirely zero take no memory at all.  Its main use
+ * is as a swap device on systems with little RAM and no (fast) disk, trading
+ * CPU time for a larger effective memory.
+ *
+ * The device structure is derived from brd.c.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/swap.h>
+#include <linux/device.h>
+#include <linux/lzo.h>
+
+#define SECTOR_SHIFT		9
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define PAGE_SECTORS		(1 << PAGE_SECTORS_SHIFT)
+
+#define ZRAM_MAX_DEVICES	32
+
+/*
+ * Pages that compress to more than this are stored uncompressed, in a page
+ * of their own: the little memory saved isn't worth decompressing them.
+ */
+#define ZRAM_MAX_ZPAGE_SIZE	(PAGE_SIZE / 4 * 3)
+
+/*
+ * Compressed pages live in a pool of slab caches, one per multiple of
+ * ZRAM_CLASS_DELTA bytes up to ZRAM_MAX_ZPAGE_SIZE.  An object thus wastes
+ * less than ZRAM_CLASS_DELTA bytes, where kmalloc would round it up to the
+ * next power of two.
+ */
+#define ZRAM_CLASS_DELTA	(PAGE_SIZE / 64)
+#define ZRAM_NR_CLASSES		(ZRAM_MAX_ZPAGE_SIZE / ZRAM_CLASS_DELTA)
+
+static struct kmem_cache *zram_cache[ZRAM_NR_CLASSES];
+static char zram_cache_name[ZRAM_NR_CLASSES][16];
+
+static inline int zram_class(size_t size)
+{
+	return (size - 1) / ZRAM_CLASS_DELTA;
+}
+
+static inline size_t zram_class_size(int class)
+{
+	return (class + 1) * ZRAM_CLASS_DELTA;
+}
+
+/* zram_entry.flags */
+#define ZRAM_ZERO		0x01	/* all zero, nothing allocated */
+#define ZRAM_UNCOMPRESSED	0x02	/* handle is a struct page */
+
+struct zram_entry {
+	void		*handle;	/* compressed data or struct page */
+	unsigned int	size;		/* compressed size */
+	unsigned int	flags;
+};
+
+struct zram_stats {
+	u64		num_reads;	/* completed page reads */
+	u64		num_writes;	/* completed page writes */
+	u64		invalid_io;	/* non page-aligned requests */
+	u64		notify_free;	/* slots freed by swap */
+	u64		pages_zero;	/* zero filled pages */
+	u64		pages_stored;	/* pages holding data */
+	u64		compr_size;	/* compressed size of pages_stored */
+	u64		mem_used;	/* memory allocated for pages_stored */
+};
+
+struct zram {
+	int			number;
+	struct request_queue	*queue;
+	struct gendisk		*disk;
+
+	/* One entry per page of the device, protected by table_lock */
+	struct zram_entry	*table;
+	unsigned long		nr_pages;
+	rwlock_t		table_lock;
+
+	/* Serialises compression, which uses these buffers */
+	struct mutex		compress_lock;
+	void			*compress_workmem;
+	void			*compress_buffer;
+
+	spinlock_t		stat_lock;
+	struct zram_stats	stats;
+};
+
+static int zram_major;
+static struct zram *zram_devices;
+
+static unsigned int num_devices = 1;
+static unsigned long disksize;
+
+static inline void zram_stat_add(struct zram *zram, u64 *v, s64 delta)
+{
+	spin_lock(&zram->stat_lock);
+	*v += delta;
+	spin_unlock(&zram->stat_lock);
+}
+
+static inline u64 zram_stat_read(struct zram *zram, u64 *v)
+{
+	u64 val;
+
+	spin_lock(&zram->stat_lock);
+	val = *v;
+	spin_unlock(&zram->stat_lock);
+	return val;
+}
+
+static int zram_page_zero_filled(void *ptr)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		if (page[pos])
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Release the memory held by a table entry, which is left empty.
+ * Called with table_lock held for writing.
+ */
+static void zram_free_entry(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_stats *stats = &zram->stats;
+
+	spin_lock(&zram->stat_lock);
+	if (entry->flags & ZRAM_ZERO) {
+		stats->pages_zero--;
+	} else if (entry->flags & ZRAM_UNCOMPRESSED) {
+		__free_page(entry->handle);
+		stats->pages_stored--;
+		stats->compr_size -= PAGE_SIZE;
+		stats->mem_used -= PAGE_SIZE;
+	} else if (entry->handle) {
+		int class = zram_class(entry->size);
+
+		kmem_cache_free(zram_cache[class], entry->handle);
+		stats->pages_stored--;
+		stats->compr_size -= entry->size;
+		stats->mem_used -= zram_class_size(class);
+	}
+	spin_unlock(&zram->stat_lock);
+
+	entry->handle = NULL;
+	entry->size = 0;
+	entry->flags = 0;
+}
+
+static int zram_read(struct zram *zram, struct page *page, unsigned long index)
+{
+	struct zram_entry *entry;
+	unsigned char *dst, *src;
+	size_t clen = PAGE_SIZE;
+	int ret = LZO_E_OK;
+
+	read_lock(&zram->table_lock);
+	entry = &zram->table[index];
+	dst = kmap_atomic(page, KM_USER0);
+	if (entry->flags & ZRAM_UNCOMPRESSED) {
+		src = kmap_atomic(entry->handle, KM_USER1);
+		memcpy(dst, src, PAGE_SIZE);
+		kunmap_atomic(src, KM_USER1);
+	} else if (entry->handle) {
+		ret = lzo1x_decompress_safe(entry->handle, entry->size,
+					    dst, &clen);
+	} else {
+		/* zero filled or never written */
+		memset(dst, 0, PAGE_SIZE);
+	}
+	kunmap_atomic(dst, KM_USER0);
+	read_unlock(&zram->table_lock);
+
+	flush_dcache_page(page);
+
+	if (unlikely(ret != LZO_E_OK || clen != PAGE_SIZE)) {
+		printk(KERN_ERR "zram%d: decompression failed for page %lu\n",
+		       zram->number, index);
+		return -EIO;
+	}
+
+	zram_stat_add(zram, &zram->stats.num_reads, 1);
+	return 0;
+}
+
+static int zram_write(struct zram *zram, struct page *page, unsigned long index)
+{
+	struct zram_entry new = { NULL, 0, 0 };
+	size_t clen = lzo1x_worst_compress(PAGE_SIZE);
+	unsigned char *src;
+	s64 mem;
+	int ret;
+
+	mutex_lock(&zram->compress_lock);
+	src = kmap_atomic(page, KM_USER0);
+	if (zram_page_zero_filled(src)) {
+		kunmap_atomic(src, KM_USER0);
+		mutex_unlock(&zram->compress_lock);
+		new.flags = ZRAM_ZERO;
+		goto store;
+	}
+	ret = lzo1x_1_compress(src, PAGE_SIZE, zram->compress_buffer, &clen,
+			       zram->compress_workmem);
+	kunmap_atomic(src, KM_USER0);
+
+	if (unlikely(ret != LZO_E_OK)) {
+		mutex_unlock(&zram->compress_lock);
+		printk(KERN_ERR "zram%d: compression failed for page %lu\n",
+		       zram->number, index);
+		return -EIO;
+	}
+
+	if (clen > ZRAM_MAX_ZPAGE_SIZE) {
+		struct page *zpage;
+
+		mutex_unlock(&zram->compress_lock);
+		zpage = alloc_page(GFP_NOIO | __GFP_HIGHMEM | __GFP_NOWARN);
+		if (!zpage)
+			return -ENOMEM;
+		copy_highpage(zpage, page);
+		new.handle = zpage;
+		new.size = PAGE_SIZE;
+		new.flags = ZRAM_UNCOMPRESSED;
+		mem = PAGE_SIZE;
+	} else {
+		int class = zram_class(clen);
+
+		new.handle = kmem_cache_alloc(zram_cache[class],
+					      GFP_NOIO | __GFP_NOWARN);
+		if (!new.handle) {
+			mutex_unlock(&zram->compress_lock);
+			return -ENOMEM;
+		}
+		memcpy(new.handle, zram->compress_buffer, clen);
+		mutex_unlock(&zram->compress_lock);
+		new.size = clen;
+		mem = zram_class_size(class);
+	}
+
+	spin_lock(&zram->stat_lock);
+	zram->stats.pages_stored++;
+	zram->stats.compr_size += new.size;
+	zram->stats.mem_used += mem;
+	spin_unlock(&zram->stat_lock);
+	goto replace;
+
+store:
+	zram_stat_add(zram, &zram->stats.pages_zero, 1);
+replace:
+	write_lock(&zram->table_lock);
+	zram_free_entry(zram, &zram->table[index]);
+	zram->table[index] = new;
+	write_unlock(&zram->table_lock);
+
+	zram_stat_add(zram, &zram->stats.num_writes, 1);
+	return 0;
+}
+
+static inline int zram_valid_io(struct zram *zram, struct bio *bio)
+{
+	if (unlikely(bio->bi_sector & (PAGE_SECTORS - 1)))
+		return 0;
+	if (unlikely(bio->bi_size & (PAGE_SIZE - 1)))
+		return 0;
+	if (unlikely((bio->bi_sector >> PAGE_SECTORS_SHIFT) +
+		     (bio->bi_size >> PAGE_SHIFT) > zram->nr_pages))
+		return 0;
+	return 1;
+}
+
+static int zram_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct zram *zram = q->queuedata;
+	struct bio_vec *bvec;
+	unsigned long index;
+	int i, err = 0;
+
+	if (!zram_valid_io(zram, bio))
+		goto invalid;
+
+	index = bio->bi_sector >> PAGE_SECTORS_SHIFT;
+	bio_for_each_segment(bvec, bio, i) {
+		if (unlikely(bvec->bv_len != PAGE_SIZE || bvec->bv_offset))
+			goto invalid;
+
+		if (bio_data_dir(bio) == WRITE)
+			err = zram_write(zram, bvec->bv_page, index);
+		else
+			err = zram_read(zram, bvec->bv_page, index);
+		if (err)
+			break;
+		index++;
+	}
+
+	bio_endio(bio, err);
+	return 0;
+
+invalid:
+	zram_stat_add(zram, &zram->stats.invalid_io, 1);
+	bio_io_error(bio);
+	return 0;
+}
+
+/*
+ * Swap tells us when a slot is no longer used, so the memory backing it
+ * can be released right away rather than when the slot is rewritten.
+ */
+static void zram_slot_free_notify(struct block_device *bdev,
+				  unsigned long index)
+{
+	struct zram *zram = bdev->bd_disk->private_data;
+
+	write_lock(&zram->table_lock);
+	zram_free_entry(zram, &zram->table[index]);
+	write_unlock(&zram->table_lock);
+
+	zram_stat_add(zram, &zram->stats.notify_free, 1);
+}
+
+static struct block_device_operations zram_fops = {
+	.owner =		THIS_MODULE,
+	.swap_slot_free_notify = zram_slot_free_notify,
+};
+
+/*
+ * Statistics, in /sys/block/zram<id>/
+ */
+static inline struct zram *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+static ssize_t disksize_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		       (u64)zram->nr_pages << PAGE_SHIFT);
+}
+
+#define ZRAM_STAT_ATTR(name, field, shift)				\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct zram *zram = dev_to_zram(dev);				\
+									\
+	return sprintf(buf, "%llu\n",					\
+		       zram_stat_read(zram, &zram->stats.field) << (shift)); \
+}									\
+static DEVICE_ATTR(name, S_IRUGO, name##_show, NULL)
+
+static DEVICE_ATTR(disksize, S_IRUGO, disksize_show, NULL);
+ZRAM_STAT_ATTR(num_reads, num_reads, 0);
+ZRAM_STAT_ATTR(num_writes, num_writes, 0);
+ZRAM_STAT_ATTR(invalid_io, invalid_io, 0);
+ZRAM_STAT_ATTR(notify_free, notify_free, 0);
+ZRAM_STAT_ATTR(zero_pages, pages_zero, 0);
+ZRAM_STAT_ATTR(orig_data_size, pages_stored, PAGE_SHIFT);
+ZRAM_STAT_ATTR(compr_data_size, compr_size, 0);
+ZRAM_STAT_ATTR(mem_used_total, mem_used, 0);
+
+static struct attribute *zram_disk_attrs[] = {
+	&dev_attr_disksize.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_invalid_io.attr,
+	&dev_attr_notify_free.attr,
+	&dev_attr_zero_pages.attr,
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	NULL,
+};
+
+static struct attribute_group zram_disk_attr_group = {
+	.attrs = zram_disk_attrs,
+};
+
+static void zram_free_table(struct zram *zram)
+{
+	unsigned long index;
+
+	if (!zram->table)
+		return;
+
+	write_lock(&zram->table_lock);
+	for (index = 0; index < zram->nr_pages; index++)
+		zram_free_entry(zram, &zram->table[index]);
+	write_unlock(&zram->table_lock);
+
+	vfree(zram->table);
+	zram->table = NULL;
+}
+
+static int zram_alloc(struct zram *zram, int i)
+{
+	struct gendisk *disk;
+
+	zram->number = i;
+	rwlock_init(&zram->table_lock);
+	mutex_init(&zram->compress_lock);
+	spin_lock_init(&zram->stat_lock);
+
+	zram->nr_pages = disksize >> PAGE_SHIFT;
+	zram->table = vmalloc(zram->nr_pages * sizeof(*zram->table));
+	if (!zram->table)
+		goto out;
+	memset(zram->table, 0, zram->nr_pages * sizeof(*zram->table));
+
+	zram->compress_workmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	zram->compress_buffer = kmalloc(lzo1x_worst_compress(PAGE_SIZE),
+					GFP_KERNEL);
+	if (!zram->compress_workmem || !zram->compress_buffer)
+		goto out_free_buffers;
+
+	zram->queue = blk_alloc_queue(GFP_KERNEL);
+	if (!zram->queue)
+		goto out_free_buffers;
+	zram->queue->queuedata = zram;
+	blk_queue_make_request(zram->queue, zram_make_request);
+	blk_queue_ordered(zram->queue, QUEUE_ORDERED_TAG, NULL);
+	blk_queue_logical_block_size(zram->queue, PAGE_SIZE);
+	blk_queue_bounce_limit(zram->queue, BLK_BOUNCE_ANY);
+
+	disk = zram->disk = alloc_disk(1);
+	if (!disk)
+		goto out_free_queue;
+	disk->major		= zram_major;
+	disk->first_minor	= i;
+	disk->fops		= &zram_fops;
+	disk->private_data	= zram;
+	disk->queue		= zram->queue;
+	sprintf(disk->disk_name, "zram%d", i);
+	set_capacity(disk, (sector_t)zram->nr_pages << PAGE_SECTORS_SHIFT);
+
+	return 0;
+
+out_free_queue:
+	blk_cleanup_queue(zram->queue);
+out_free_buffers:
+	kfree(zram->compress_buffer);
+	kfree(zram->compress_workmem);
+	vfree(zram->table);
+out:
+	return -ENOMEM;
+}
+
+static void zram_free(struct zram *zram)
+{
+	put_disk(zram->disk);
+	blk_cleanup_queue(zram->queue);
+	zram_free_table(zram);
+	kfree(zram->compress_buffer);
+	kfree(zram->compress_workmem);
+}
+
+static void zram_destroy_caches(void)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_NR_CLASSES; i++)
+		if (zram_cache[i])
+			kmem_cache_destroy(zram_cache[i]);
+}
+
+static int __init zram_create_caches(void)
+{
+	int i;
+
+	for (i = 0; i < ZRAM_NR_CLASSES; i++) {
+		sprintf(zram_cache_name[i], "zram-%zu", zram_class_size(i));
+		zram_cache[i] = kmem_cache_create(zram_cache_name[i],
+						  zram_class_size(i), 0, 0,
+						  NULL);
+		if (!zram_cache[i]) {
+			zram_destroy_caches();
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static int __init zram_init(void)
+{
+	int i, err;
+
+	if (num_devices < 1 || num_devices > ZRAM_MAX_DEVICES) {
+		printk(KERN_ERR "zram: invalid num_devices %u\n", num_devices);
+		return -EINVAL;
+	}
+
+	/* default to a quarter of RAM */
+	if (!disksize)
+		disksize = (totalram_pages << PAGE_SHIFT) / 4;
+	else
+		disksize <<= 10;
+	disksize &= PAGE_MASK;
+	if (!disksize)
+		return -EINVAL;
+
+	err = zram_create_caches();
+	if (err)
+		return err;
+
+	zram_major = register_blkdev(0, "zram");
+	if (zram_major <= 0) {
+		err = -EBUSY;
+		goto out_caches;
+	}
+
+	err = -ENOMEM;
+	zram_devices = kcalloc(num_devices, sizeof(*zram_devices), GFP_KERNEL);
+	if (!zram_devices)
+		goto out_unregister;
+
+	for (i = 0; i < num_devices; i++) {
+		err = zram_alloc(&zram_devices[i], i);
+		if (err)
+			goto out_free;
+	}
+
+	/* point of no return */
+
+	for (i = 0; i < num_devices; i++) {
+		add_disk(zram_devices[i].disk);
+		if (sysfs_create_group(&disk_to_dev(zram_devices[i].disk)->kobj,
+				       &zram_disk_attr_group))
+			printk(KERN_WARNING "zram%d: failed to create sysfs "
+			       "attributes\n", i);
+	}
+
+	printk(KERN_INFO "zram: %u device(s) of %lu KiB\n", num_devices,
+	       disksize >> 10);
+	return 0;
+
+out_free:
+	while (--i >= 0)
+		zram_free(&zram_devices[i]);
+	kfree(zram_devices);
+out_unregister:
+	unregister_blkdev(zram_major, "zram");
+out_caches:
+	zram_destroy_caches();
+	return err;
+}
+
+static void __exit zram_exit(void)
+{
+	int i;
+
+	for (i = 0; i < num_devices; i++) {
+		struct zram *zram = &zram_devices[i];
+
+		sysfs_remove_group(&disk_to_dev(zram->disk)->kobj,
+				   &zram_disk_attr_group);
+		del_gendisk(zram->disk);
+		zram_free(zram);
+	}
+	kfree(zram_devices);
+
+	unregister_blkdev(zram_major, "zram");
+	zram_destroy_caches();
+}
+
+module_init(zram_init);
+module_exit(zram_exit);
+
+module_param(num_devices, uint, 0);
+MODULE_PARM_DESC(num_devices, "Number of zram devices");
+module_param(disksize, ulong, 0);
+MODULE_PARM_DESC(disksize, "Size of each device in kbytes (default: 25% of RAM)");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed RAM block device");
@@ -18,6 +18,8 @@
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
 #include <linux/backing-dev.h>
+#include <linux/kthread.h>
+#include <linux/rbtree.h>
 #include <asm/atomic.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -41,6 +43,7 @@ struct convert_context {
 	unsigned int idx_out;
 	sector_t sector;
 	atomic_t pending;
+	struct ablkcipher_request *req;
 };
 
 /*
@@ -65,6 +68,17 @@ struct dm_crypt_request {
 	struct scatterlist sg_out;
 };
 
+/*
+ * Every clone bio is allocated with room in front of it to queue it on
+ * the write thread's sorted tree once its data has been encrypted.
+ */
+struct dm_crypt_clone {
+	struct rb_node rb_node;
+	struct bio bio;
+};
+
+#define clone_of_bio(b)	container_of(b, struct dm_crypt_clone, bio)
+
 struct crypt_config;
 
 struct crypt_iv_operations {
@@ -93,9 +107,22 @@ struct crypt_config {
 	mempool_t *page_pool;
 	struct bio_set *bs;
 
+	/*
+	 * serializes the blocking part of buffer page allocation: workers
+	 * on several CPUs each holding part of a bio could drain page_pool
+	 */
+	struct mutex bio_alloc_lock;
+
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
 
+	/*
+	 * encrypted writes waiting to be submitted, sorted by sector
+	 */
+	struct task_struct *write_thread;
+	spinlock_t write_lock;
+	struct rb_root write_tree;
+
 	/*
 	 * crypto related data
 	 */
@@ -122,7 +149,6 @@ struct crypt_config {
 	 * correctly aligned.
 	 */
 	unsigned int dmreq_start;
-	struct ablkcipher_request *req;
 
 	char cipher[CRYPTO_MAX_ALG_NAME];
 	char chainmode[CRYPTO_MAX_ALG_NAME];
@@ -333,6 +359,7 @@ static void crypt_convert_init(struct crypt_config *cc,
 	ctx->idx_in = bio_in ? bio_in->bi_idx : 0;
 	ctx->idx_out = bio_out ? bio_out->bi_idx : 0;
 	ctx->sector = sector + cc->iv_offset;
+	ctx->req = NULL;
 	init_completion(&ctx->restart);
 }
 
@@ -402,16 +429,30 @@ static int crypt_convert_block(struct crypt_config *cc,
 
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
+/*
+ * The crypto request is kept in the conversion context, so that a
+ * synchronous cipher reuses it for every sector.  Conversions run
+ * concurrently on all CPUs, so nothing in crypt_config may be used.
+ */
 static void crypt_alloc_req(struct crypt_config *cc,
 			    struct convert_context *ctx)
 {
-	if (!cc->req)
-		cc->req = mempool_alloc(cc->req_pool, GFP_NOIO);
-	ablkcipher_request_set_tfm(cc->req, cc->tfm);
-	ablkcipher_request_set_callback(cc->req, CRYPTO_TFM_REQ_MAY_BACKLOG |
+	if (!ctx->req)
+		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	ablkcipher_request_set_tfm(ctx->req, cc->tfm);
+	ablkcipher_request_set_callback(ctx->req, CRYPTO_TFM_REQ_MAY_BACKLOG |
 					CRYPTO_TFM_REQ_MAY_SLEEP,
 					kcryptd_async_done,
-					dmreq_of_req(cc, cc->req));
+					dmreq_of_req(cc, ctx->req));
+}
+
+static void crypt_free_req(struct crypt_config *cc,
+			   struct convert_context *ctx)
+{
+	if (ctx->req) {
+		mempool_free(ctx->req, cc->req_pool);
+		ctx->req = NULL;
+	}
 }
 
 /*
@@ -431,7 +472,7 @@ static int crypt_convert(struct crypt_config *cc,
 
 		atomic_inc(&ctx->pending);
 
-		r = crypt_convert_block(cc, ctx, cc->req);
+		r = crypt_convert_block(cc, ctx, ctx->req);
 
 		switch (r) {
 		/* async */
@@ -440,7 +481,7 @@ static int crypt_convert(struct crypt_config *cc,
 			INIT_COMPLETION(ctx->restart);
 			/* fall through*/
 		case -EINPROGRESS:
-			cc->req = NULL;
+			ctx->req = NULL;
 			ctx->sector++;
 			continue;
 
@@ -454,10 +495,12 @@ static int crypt_convert(struct crypt_config *cc,
 		/* error */
 		default:
 			atomic_dec(&ctx->pending);
+			crypt_free_req(cc, ctx);
 			return r;
 		}
 	}
 
+	crypt_free_req(cc, ctx);
 	return 0;
 }
 
@@ -492,6 +535,8 @@ static struct bio *crypt_alloc_buffer(struct dm_crypt_io *io, unsigned size,
 	clone_init(io, clone);
 	*out_of_pages = 0;
 
+	mutex_lock(&cc->bio_alloc_lock);
+
 	for (i = 0; i < nr_iovecs; i++) {
 		page = mempool_alloc(cc->page_pool, gfp_mask);
 		if (!page) {
@@ -517,6 +562,8 @@ static struct bio *crypt_alloc_buffer(struct dm_crypt_io *io, unsigned size,
 		size -= len;
 	}
 
+	mutex_unlock(&cc->bio_alloc_lock);
+
 	if (!clone->bi_size) {
 		bio_put(clone);
 		return NULL;
@@ -587,14 +634,21 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
 }
 
 /*
- * kcryptd/kcryptd_io:
+ * kcryptd/kcryptd_io/dmcrypt_write:
  *
  * Needed because it would be very unwise to do decryption in an
  * interrupt context.
  *
- * kcryptd performs the actual encryption or decryption.
+ * kcryptd performs the actual encryption or decryption.  It has one
+ * thread per CPU and work is queued on the CPU that submitted the bio
+ * (or completed the read), so that several CPUs can encrypt bios for
+ * the same device in parallel.
  *
- * kcryptd_io performs the IO submission.
+ * kcryptd_io performs the read IO submission.
+ *
+ * dmcrypt_write submits the encrypted writes.  They complete out of
+ * order when several CPUs encrypt in parallel, so they are collected
+ * in a tree and submitted in ascending sector order.
  *
  * They must be separated as otherwise the final stages could be
  * starved by new requests which can block in the first stages due
@@ -670,20 +724,11 @@ static void kcryptd_io_read(struct dm_crypt_io *io)
 	generic_make_request(clone);
 }
 
-static void kcryptd_io_write(struct dm_crypt_io *io)
-{
-	struct bio *clone = io->ctx.bio_out;
-	generic_make_request(clone);
-}
-
 static void kcryptd_io(struct work_struct *work)
 {
 	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
 
-	if (bio_data_dir(io->base_bio) == READ)
-		kcryptd_io_read(io);
-	else
-		kcryptd_io_write(io);
+	kcryptd_io_read(io);
 }
 
 static void kcryptd_queue_io(struct dm_crypt_io *io)
@@ -694,8 +739,65 @@ static void kcryptd_queue_io(struct dm_crypt_io *io)
 	queue_work(cc->io_queue, &io->work);
 }
 
-static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io,
-					  int error, int async)
+static int dmcrypt_write(void *data)
+{
+	struct crypt_config *cc = data;
+	struct rb_root write_tree;
+	struct rb_node *node;
+	struct dm_crypt_clone *c;
+
+	while (1) {
+		spin_lock_irq(&cc->write_lock);
+		while (RB_EMPTY_ROOT(&cc->write_tree)) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			spin_unlock_irq(&cc->write_lock);
+
+			if (kthread_should_stop()) {
+				__set_current_state(TASK_RUNNING);
+				return 0;
+			}
+
+			schedule();
+			spin_lock_irq(&cc->write_lock);
+		}
+		__set_current_state(TASK_RUNNING);
+
+		write_tree = cc->write_tree;
+		cc->write_tree = RB_ROOT;
+		spin_unlock_irq(&cc->write_lock);
+
+		while ((node = rb_first(&write_tree))) {
+			rb_erase(node, &write_tree);
+			c = rb_entry(node, struct dm_crypt_clone, rb_node);
+			generic_make_request(&c->bio);
+		}
+	}
+}
+
+static void kcryptd_queue_write(struct crypt_config *cc, struct bio *clone)
+{
+	struct rb_node **p, *parent = NULL;
+	struct dm_crypt_clone *c;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cc->write_lock, flags);
+	p = &cc->write_tree.rb_node;
+	while (*p) {
+		parent = *p;
+		c = rb_entry(parent, struct dm_crypt_clone, rb_node);
+		if (clone->bi_sector < c->bio.bi_sector)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&clone_of_bio(clone)->rb_node, parent, p);
+	rb_insert_color(&clone_of_bio(clone)->rb_node, &cc->write_tree);
+	spin_unlock_irqrestore(&cc->write_lock, flags);
+
+	wake_up_process(cc->write_thread);
+}
+
+static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int error)
 {
 	struct bio *clone = io->ctx.bio_out;
 	struct crypt_config *cc = io->target->private;
@@ -713,10 +815,7 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io,
 
 	clone->bi_sector = cc->start + io->sector;
 
-	if (async)
-		kcryptd_queue_io(io);
-	else
-		generic_make_request(clone);
+	kcryptd_queue_write(cc, clone);
 }
 
 static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
@@ -759,7 +858,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		/* Encryption was already finished, submit io now */
 		if (crypt_finished) {
-			kcryptd_crypt_write_io_submit(io, r, 0);
+			kcryptd_crypt_write_io_submit(io, r);
 
 			/*
 			 * If there was an error, do not try next fragments.
@@ -857,7 +956,7 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 	if (bio_data_dir(io->base_bio) == READ)
 		kcryptd_crypt_read_done(io, error);
 	else
-		kcryptd_crypt_write_io_submit(io, error, 1);
+		kcryptd_crypt_write_io_submit(io, error);
 }
 
 static void kcryptd_crypt(struct work_struct *work)
@@ -1071,15 +1170,13 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		ti->error = "Cannot allocate crypt request mempool";
 		goto bad_req_pool;
 	}
-	cc->req = NULL;
-
 	cc->page_pool = mempool_create_page_pool(MIN_POOL_PAGES, 0);
 	if (!cc->page_pool) {
 		ti->error = "Cannot allocate page mempool";
 		goto bad_page_pool;
 	}
 
-	cc->bs = bioset_create(MIN_IOS, 0);
+	cc->bs = bioset_create(MIN_IOS, offsetof(struct dm_crypt_clone, bio));
 	if (!cc->bs) {
 		ti->error = "Cannot allocate crypt bioset";
 		goto bad_bs;
@@ -1126,16 +1223,29 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad_io_queue;
 	}
 
-	cc->crypt_queue = create_singlethread_workqueue("kcryptd");
+	cc->crypt_queue = create_workqueue("kcryptd");
 	if (!cc->crypt_queue) {
 		ti->error = "Couldn't create kcryptd queue";
 		goto bad_crypt_queue;
 	}
 
+	mutex_init(&cc->bio_alloc_lock);
+	spin_lock_init(&cc->write_lock);
+	cc->write_tree = RB_ROOT;
+
+	cc->write_thread = kthread_create(dmcrypt_write, cc, "dmcrypt_write");
+	if (IS_ERR(cc->write_thread)) {
+		ti->error = "Couldn't spawn write thread";
+		goto bad_write_thread;
+	}
+	wake_up_process(cc->write_thread);
+
 	ti->num_flush_requests = 1;
 	ti->private = cc;
 	return 0;
 
+bad_write_thread:
+	destroy_workqueue(cc->crypt_queue);
 bad_crypt_queue:
 	destroy_workqueue(cc->io_queue);
 bad_io_queue:
@@ -1167,9 +1277,7 @@ static void crypt_dtr(struct dm_target *ti)
 
 	destroy_workqueue(cc->io_queue);
 	destroy_workqueue(cc->crypt_queue);
-
-	if (cc->req)
-		mempool_free(cc->req, cc->req_pool);
+	kthread_stop(cc->write_thread);
 
 	bioset_free(cc->bs);
 	mempool_destroy(cc->page_pool);
@@ -1323,7 +1431,7 @@ static int crypt_iterate_devices(struct dm_target *ti,
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 7, 0},
+	.version = {1, 8, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -2114,6 +2114,8 @@ static void e1000_clean_tx_ring(struct e1000_adapter *adapter,
 
 	writel(0, hw->hw_addr + tx_ring->tdh);
 	writel(0, hw->hw_addr + tx_ring->tdt);
+
+	netdev_reset_queue(adapter->netdev);
 }
 
 /**
@@ -3374,6 +3376,8 @@ static int e1000_xmit_frame(struct sk_buff *skb, struct net_device *netdev)
 	                     nr_frags, mss);
 
 	if (count) {
+		/* Account before the hardware can complete the packet */
+		netdev_sent_queue(netdev, skb->len);
 		e1000_tx_queue(adapter, tx_ring, tx_flags, count);
 		/* Make sure there is space in the ring for the next send. */
 		e1000_maybe_stop_tx(netdev, tx_ring, MAX_SKB_FRAGS + 2);
@@ -3847,6 +3851,7 @@ static bool e1000_clean_tx_irq(struct e1000_adapter *adapter,
 	unsigned int i, eop;
 	unsigned int count = 0;
 	unsigned int total_tx_bytes=0, total_tx_packets=0;
+	unsigned int bql_bytes = 0, bql_packets = 0;
 
 	i = tx_ring->next_to_clean;
 	eop = tx_ring->buffer_info[i].next_to_watch;
@@ -3869,6 +3874,9 @@ static bool e1000_clean_tx_irq(struct e1000_adapter *adapter,
 				            skb->len;
 				total_tx_packets += segs;
 				total_tx_bytes += bytecount;
+				/* what e1000_xmit_frame() reported */
+				bql_bytes += skb->len;
+				bql_packets++;
 			}
 			e1000_unmap_and_free_tx_resource(adapter, buffer_info);
 			tx_desc->upper.data = 0;
@@ -3882,6 +3890,8 @@ static bool e1000_clean_tx_irq(struct e1000_adapter *adapter,
 
 	tx_ring->next_to_clean = i;
 
+	netdev_completed_queue(netdev, bql_packets, bql_bytes);
+
 #define TX_WAKE_THRESHOLD 32
 	if (unlikely(count && netif_carrier_ok(netdev) &&
 		     E1000_DESC_UNUSED(tx_ring) >= TX_WAKE_THRESHOLD)) {
@@ -32,6 +32,8 @@
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
 #include <linux/skbuff.h>
+#include <linux/workqueue.h>
+#include <linux/rtnetlink.h>
 
 #include <asm/io.h>
 #include <asm/delay.h>
@@ -57,6 +59,13 @@ struct mpc52xx_fec_priv {
 	spinlock_t lock;
 	int msg_enable;
 
+	/* RX and TX completion are both handled from NAPI context */
+	struct napi_struct napi;
+	struct sk_buff_head rx_recycle;
+
+	/* FIFO error and TX timeout recovery, run in process context */
+	struct work_struct reset_task;
+
 	/* MDIO link details */
 	unsigned int mdio_speed;
 	struct device_node *phy_node;
@@ -71,7 +80,6 @@ static irqreturn_t mpc52xx_fec_rx_interrupt(int, void *);
 static irqreturn_t mpc52xx_fec_tx_interrupt(int, void *);
 static void mpc52xx_fec_stop(struct net_device *dev);
 static void mpc52xx_fec_start(struct net_device *dev);
-static void mpc52xx_fec_reset(struct net_device *dev);
 
 static u8 mpc52xx_fec_mac_addr[6];
 module_param_array_named(mac, mpc52xx_fec_mac_addr, byte, NULL, 0);
@@ -83,15 +91,23 @@ static int debug = -1;	/* the above default */
 module_param(debug, int, 0);
 MODULE_PARM_DESC(debug, "debugging messages level");
 
+static int napi_weight = FEC_NAPI_WEIGHT;
+module_param(napi_weight, int, 0444);
+MODULE_PARM_DESC(napi_weight, "maximum frames processed per NAPI poll");
+
+static int rx_copybreak = FEC_RX_COPYBREAK;
+module_param(rx_copybreak, int, 0644);
+MODULE_PARM_DESC(rx_copybreak, "frames shorter than this are copied and the RX buffer reused");
+
 static void mpc52xx_fec_tx_timeout(struct net_device *dev)
 {
-	dev_warn(&dev->dev, "transmit timed out\n");
+	struct mpc52xx_fec_priv *priv = netdev_priv(dev);
 
-	mpc52xx_fec_reset(dev);
+	dev_warn(&dev->dev, "transmit timed out\n");
 
 	dev->stats.tx_errors++;
 
-	netif_wake_queue(dev);
+	schedule_work(&priv->reset_task);
 }
 
 static void mpc52xx_fec_set_paddr(struct net_device *dev, u8 *mac)
@@ -129,8 +145,8 @@ static void mpc52xx_fec_free_rx_buffers(struct net_device *dev, struct bcom_task
 		struct sk_buff *skb;
 
 		skb = bcom_retrieve_buffer(s, NULL, (struct bcom_bd **)&bd);
-		dma_unmap_single(dev->dev.parent, bd->skb_pa, skb->len,
-				 DMA_FROM_DEVICE);
+		dma_unmap_single(dev->dev.parent, bd->skb_pa,
+				 FEC_RX_BUFFER_SIZE, DMA_FROM_DEVICE);
 		kfree_skb(skb);
 	}
 }
@@ -160,6 +176,19 @@ static int mpc52xx_fec_alloc_rx_buffers(struct net_device *dev, struct bcom_task
 	return 0;
 }
 
+/* Get an RX buffer, preferring one recycled from the TX completion path */
+static struct sk_buff *mpc52xx_fec_new_rx_skb(struct net_device *dev)
+{
+	struct mpc52xx_fec_priv *priv = netdev_priv(dev);
+	struct sk_buff *skb;
+
+	skb = __skb_dequeue(&priv->rx_recycle);
+	if (!skb)
+		skb = netdev_alloc_skb(dev, FEC_RX_BUFFER_SIZE);
+
+	return skb;
+}
+
 /* based on generic_adjust_link from fs_enet-main.c */
 static void mpc52xx_fec_adjust_link(struct net_device *dev)
 {
@@ -251,6 +280,8 @@ static int mpc52xx_fec_open(struct net_device *dev)
 		goto free_irqs;
 	}
 
+	napi_enable(&priv->napi);
+
 	bcom_enable(priv->rx_dmatsk);
 	bcom_enable(priv->tx_dmatsk);
 
@@ -282,6 +313,8 @@ static int mpc52xx_fec_close(struct net_device *dev)
 
 	netif_stop_queue(dev);
 
+	napi_disable(&priv->napi);
+
 	mpc52xx_fec_stop(dev);
 
 	mpc52xx_fec_free_rx_buffers(dev, priv->rx_dmatsk);
@@ -290,6 +323,8 @@ static int mpc52xx_fec_close(struct net_device *dev)
 	free_irq(priv->r_irq, dev);
 	free_irq(priv->t_irq, dev);
 
+	skb_queue_purge(&priv->rx_recycle);
+
 	if (priv->phydev) {
 		/* power down phy */
 		phy_stop(priv->phydev);
@@ -352,99 +387,182 @@ static void mpc52xx_fec_poll_controller(struct net_device *dev)
 #endif
 
 
+/* Mask both BestComm task interrupts and hand the work over to NAPI.
+ * They stay masked until mpc52xx_fec_poll() has drained the rings.
+ */
+static void mpc52xx_fec_schedule_poll(struct net_device *dev)
+{
+	struct mpc52xx_fec_priv *priv = netdev_priv(dev);
+
+	if (napi_schedule_prep(&priv->napi)) {
+		disable_irq_nosync(priv->r_irq);
+		disable_irq_nosync(priv->t_irq);
+		__napi_schedule(&priv->napi);
+	}
+}
+
 /* This handles BestComm transmit task interrupts
  */
 static irqreturn_t mpc52xx_fec_tx_interrupt(int irq, void *dev_id)
 {
-	struct net_device *dev = dev_id;
+	mpc52xx_fec_schedule_poll(dev_id);
+
+	return IRQ_HANDLED;
+}
+
+/* This handles BestComm receive task interrupts
+ */
+static irqreturn_t mpc52xx_fec_rx_interrupt(int irq, void *dev_id)
+{
+	mpc52xx_fec_schedule_poll(dev_id);
+
+	return IRQ_HANDLED;
+}
+
+static void mpc52xx_fec_tx_reclaim(struct net_device *dev)
+{
 	struct mpc52xx_fec_priv *priv = netdev_priv(dev);
+	struct sk_buff_head done;
+	struct sk_buff *skb;
+	unsigned long flags;
 
-	spin_lock(&priv->lock);
+	__skb_queue_head_init(&done);
+
+	spin_lock_irqsave(&priv->lock, flags);
 
 	while (bcom_buffer_done(priv->tx_dmatsk)) {
-		struct sk_buff *skb;
 		struct bcom_fec_bd *bd;
 		skb = bcom_retrieve_buffer(priv->tx_dmatsk, NULL,
 				(struct bcom_bd **)&bd);
 		dma_unmap_single(dev->dev.parent, bd->skb_pa, skb->len,
 				 DMA_TO_DEVICE);
 
-		dev_kfree_skb_irq(skb);
+		__skb_queue_tail(&done, skb);
 	}
 
-	netif_wake_queue(dev);
+	if (netif_queue_stopped(dev) && !bcom_queue_full(priv->tx_dmatsk))
+		netif_wake_queue(dev);
 
-	spin_unlock(&priv->lock);
+	spin_unlock_irqrestore(&priv->lock, flags);
 
-	return IRQ_HANDLED;
+	/* Sent skbs that are big enough become RX buffers again */
+	while ((skb = __skb_dequeue(&done)) != NULL) {
+		if (skb_queue_len(&priv->rx_recycle) < FEC_RX_NUM_BD &&
+		    skb_recycle_check(skb, FEC_RX_BUFFER_SIZE))
+			__skb_queue_head(&priv->rx_recycle, skb);
+		else
+			dev_kfree_skb_any(skb);
+	}
 }
 
-static irqreturn_t mpc52xx_fec_rx_interrupt(int irq, void *dev_id)
+static int mpc52xx_fec_rx(struct net_device *dev, int budget)
 {
-	struct net_device *dev = dev_id;
 	struct mpc52xx_fec_priv *priv = netdev_priv(dev);
+	struct bcom_task *rxtsk = priv->rx_dmatsk;
+	int work_done = 0;
 
-	while (bcom_buffer_done(priv->rx_dmatsk)) {
+	while (work_done < budget && bcom_buffer_done(rxtsk)) {
 		struct sk_buff *skb;
 		struct sk_buff *rskb;
 		struct bcom_fec_bd *bd;
+		dma_addr_t pa;
 		u32 status;
+		int length;
 
-		rskb = bcom_retrieve_buffer(priv->rx_dmatsk, &status,
+		rskb = bcom_retrieve_buffer(rxtsk, &status,
 				(struct bcom_bd **)&bd);
-		dma_unmap_single(dev->dev.parent, bd->skb_pa, rskb->len,
-				 DMA_FROM_DEVICE);
+		pa = bd->skb_pa;
+		work_done++;
 
 		/* Test for errors in received frame */
 		if (status & BCOM_FEC_RX_BD_ERRORS) {
-			/* Drop packet and reuse the buffer */
-			bd = (struct bcom_fec_bd *)
-				bcom_prepare_next_buffer(priv->rx_dmatsk);
-
-			bd->status = FEC_RX_BUFFER_SIZE;
-			bd->skb_pa = dma_map_single(dev->dev.parent,
-					rskb->data,
-					FEC_RX_BUFFER_SIZE, DMA_FROM_DEVICE);
-
-			bcom_submit_next_buffer(priv->rx_dmatsk, rskb);
-
+			/* Drop packet and reuse the (still mapped) buffer */
 			dev->stats.rx_dropped++;
-
-			continue;
+			skb = rskb;
+			goto requeue;
 		}
 
-		/* skbs are allocated on open, so now we allocate a new one,
-		 * and remove the old (with the packet) */
-		skb = dev_alloc_skb(FEC_RX_BUFFER_SIZE);
-		if (skb) {
-			/* Process the received skb */
-			int length = status & BCOM_FEC_RX_BD_LEN_MASK;
-
-			skb_put(rskb, length - 4);	/* length without CRC32 */
-
-			rskb->dev = dev;
-			rskb->protocol = eth_type_trans(rskb, dev);
+		length = (status & BCOM_FEC_RX_BD_LEN_MASK) - 4; /* w/o CRC32 */
+
+		/* Small frames are copied out so the mapped buffer can be
+		 * handed straight back to BestComm */
+		if (length < rx_copybreak) {
+			skb = netdev_alloc_skb(dev, length + NET_IP_ALIGN);
+			if (skb) {
+				skb_reserve(skb, NET_IP_ALIGN);
+				dma_sync_single_for_cpu(dev->dev.parent, pa,
+						length, DMA_FROM_DEVICE);
+				skb_copy_to_linear_data(skb, rskb->data,
+						length);
+				dma_sync_single_for_device(dev->dev.parent, pa,
+						length, DMA_FROM_DEVICE);
+				skb_put(skb, length);
+
+				skb->protocol = eth_type_trans(skb, dev);
+				napi_gro_receive(&priv->napi, skb);
+
+				skb = rskb;
+				goto requeue;
+			}
+		}
 
-			netif_rx(rskb);
-		} else {
+		/* Pass the buffer up and replace it with a new one */
+		skb = mpc52xx_fec_new_rx_skb(dev);
+		if (!skb) {
 			/* Can't get a new one : reuse the same & drop pkt */
 			dev_notice(&dev->dev, "Memory squeeze, dropping packet.\n");
 			dev->stats.rx_dropped++;
-
 			skb = rskb;
+			goto requeue;
 		}
 
-		bd = (struct bcom_fec_bd *)
-			bcom_prepare_next_buffer(priv->rx_dmatsk);
+		dma_unmap_single(dev->dev.parent, pa, FEC_RX_BUFFER_SIZE,
+				 DMA_FROM_DEVICE);
 
-		bd->status = FEC_RX_BUFFER_SIZE;
-		bd->skb_pa = dma_map_single(dev->dev.parent, skb->data,
+		skb_put(rskb, length);
+		rskb->protocol = eth_type_trans(rskb, dev);
+		napi_gro_receive(&priv->napi, rskb);
+
+		pa = dma_map_single(dev->dev.parent, skb->data,
 				FEC_RX_BUFFER_SIZE, DMA_FROM_DEVICE);
 
-		bcom_submit_next_buffer(priv->rx_dmatsk, skb);
+ requeue:
+		bd = (struct bcom_fec_bd *)bcom_prepare_next_buffer(rxtsk);
+
+		bd->status = FEC_RX_BUFFER_SIZE;
+		bd->skb_pa = pa;
+
+		bcom_submit_next_buffer(rxtsk, skb);
 	}
 
-	return IRQ_HANDLED;
+	return work_done;
+}
+
+static int mpc52xx_fec_poll(struct napi_struct *napi, int budget)
+{
+	struct mpc52xx_fec_priv *priv =
+		container_of(napi, struct mpc52xx_fec_priv, napi);
+	struct net_device *dev = priv->ndev;
+	int work_done;
+
+	mpc52xx_fec_tx_reclaim(dev);
+
+	work_done = mpc52xx_fec_rx(dev, budget);
+
+	if (work_done < budget) {
+		napi_complete(napi);
+
+		enable_irq(priv->r_irq);
+		enable_irq(priv->t_irq);
+
+		/* A task interrupt raised while it was masked has been
+		 * acked and lost, so look at the rings once more */
+		if (bcom_buffer_done(priv->rx_dmatsk) ||
+		    bcom_buffer_done(priv->tx_dmatsk))
+			mpc52xx_fec_schedule_poll(dev);
+	}
+
+	return work_done;
 }
 
 static irqreturn_t mpc52xx_fec_interrupt(int irq, void *dev_id)
@@ -470,9 +588,7 @@ static irqreturn_t mpc52xx_fec_interrupt(int irq, void *dev_id)
 		if (net_ratelimit() && (ievent & FEC_IEVENT_XFIFO_ERROR))
 			dev_warn(&dev->dev, "FEC_IEVENT_XFIFO_ERROR\n");
 
-		mpc52xx_fec_reset(dev);
-
-		netif_wake_queue(dev);
+		schedule_work(&priv->reset_task);
 		return IRQ_HANDLED;
 	}
 
@@ -743,12 +859,18 @@ static void mpc52xx_fec_stop(struct net_device *dev)
 	out_be32(&fec->ecntrl, in_be32(&fec->ecntrl) & ~FEC_ECNTRL_ETHER_EN);
 }
 
-/* reset fec and bestcomm tasks */
+/* reset fec and bestcomm tasks
+ * The RX ring is freed and refilled, so this must not race with
+ * mpc52xx_fec_poll(): NAPI and the transmit path are quiesced first.
+ */
 static void mpc52xx_fec_reset(struct net_device *dev)
 {
 	struct mpc52xx_fec_priv *priv = netdev_priv(dev);
 	struct mpc52xx_fec __iomem *fec = priv->fec;
 
+	netif_tx_disable(dev);
+	napi_disable(&priv->napi);
+
 	mpc52xx_fec_stop(dev);
 
 	out_be32(&fec->rfifo_status, in_be32(&fec->rfifo_status));
@@ -773,6 +895,22 @@ static void mpc52xx_fec_reset(struct net_device *dev)
 	bcom_enable(priv->tx_dmatsk);
 
 	mpc52xx_fec_start(dev);
+
+	napi_enable(&priv->napi);
+	netif_wake_queue(dev);
+}
+
+static void mpc52xx_fec_reset_task(struct work_struct *work)
+{
+	struct mpc52xx_fec_priv *priv =
+		container_of(work, struct mpc52xx_fec_priv, reset_task);
+	struct net_device *dev = priv->ndev;
+
+	/* rtnl serializes us against open and close */
+	rtnl_lock();
+	if (netif_running(dev))
+		mpc52xx_fec_reset(dev);
+	rtnl_unlock();
 }
 
 
@@ -901,6 +1039,11 @@ mpc52xx_fec_probe(struct of_device *op, const struct of_device_id *match)
 	SET_NETDEV_DEV(ndev, &op->dev);
 
 	spin_lock_init(&priv->lock);
+	skb_queue_head_init(&priv->rx_recycle);
+	INIT_WORK(&priv->reset_task, mpc52xx_fec_reset_task);
+
+	netif_napi_add(ndev, &priv->napi, mpc52xx_fec_poll, napi_weight);
+	ndev->features |= NETIF_F_GRO;
 
 	/* ioremap the zones */
 	priv->fec = ioremap(mem.start, sizeof(struct mpc52xx_fec));
@@ -1015,6 +1158,8 @@ mpc52xx_fec_remove(struct of_device *op)
 
 	unregister_netdev(ndev);
 
+	cancel_work_sync(&priv->reset_task);
+
 	if (priv->phy_node)
 		of_node_put(priv->phy_node);
 	priv->phy_node = NULL;
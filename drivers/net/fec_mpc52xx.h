@@ -21,6 +21,8 @@
 #define FEC_RX_BUFFER_SIZE	1522	/* max receive packet size */
 #define FEC_RX_NUM_BD		256
 #define FEC_TX_NUM_BD		64
+#define FEC_NAPI_WEIGHT		64	/* default RX poll budget */
+#define FEC_RX_COPYBREAK	256	/* frames below this are copied */
 
 #define FEC_RESET_DELAY		50 	/* uS */
 
@@ -106,6 +106,21 @@ static struct page *get_a_page(struct virtnet_info *vi, gfp_t gfp_mask)
 	return p;
 }
 
+/* Like get_a_page() for several pages; returns how many it got. */
+static unsigned int get_pages(struct virtnet_info *vi, struct page **pages,
+			      unsigned int nr, gfp_t gfp_mask)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr && vi->pages; i++) {
+		pages[i] = vi->pages;
+		vi->pages = (struct page *)pages[i]->private;
+	}
+	if (i < nr)
+		i += alloc_page_array(gfp_mask, nr - i, pages + i);
+	return i;
+}
+
 static void skb_xmit_done(struct virtqueue *svq)
 {
 	struct virtnet_info *vi = svq->vdev->priv;
@@ -294,12 +309,12 @@ static void try_fill_recv_maxbufs(struct virtnet_info *vi)
 		sg_set_buf(sg, hdr, sizeof(*hdr));
 
 		if (vi->big_packets) {
-			for (i = 0; i < MAX_SKB_FRAGS; i++) {
-				skb_frag_t *f = &skb_shinfo(skb)->frags[i];
-				f->page = get_a_page(vi, GFP_ATOMIC);
-				if (!f->page)
-					break;
+			struct page *pages[MAX_SKB_FRAGS];
+			int nr = get_pages(vi, pages, MAX_SKB_FRAGS, GFP_ATOMIC);
 
+			for (i = 0; i < nr; i++) {
+				skb_frag_t *f = &skb_shinfo(skb)->frags[i];
+				f->page = pages[i];
 				f->page_offset = 0;
 				f->size = PAGE_SIZE;
 
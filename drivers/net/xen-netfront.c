@@ -62,6 +62,9 @@ struct netfront_cb {
 
 #define RX_COPY_THRESHOLD 256
 
+/* Pages allocated at once when refilling the receive ring */
+#define RX_PAGE_BATCH 32
+
 #define GRANT_INVALID_REF	0
 
 #define NET_TX_RING_SIZE __RING_SIZE((struct xen_netif_tx_sring *)0, PAGE_SIZE)
@@ -221,6 +224,8 @@ static void xennet_alloc_rx_buffers(struct net_device *dev)
 	struct netfront_info *np = netdev_priv(dev);
 	struct sk_buff *skb;
 	struct page *page;
+	struct page *pages[RX_PAGE_BATCH];
+	int nr_pages = 0, next_page = 0;
 	int i, batch_target, notify;
 	RING_IDX req_prod = np->rx.req_prod_pvt;
 	grant_ref_t ref;
@@ -247,10 +252,18 @@ static void xennet_alloc_rx_buffers(struct net_device *dev)
 		/* Align ip header to a 16 bytes boundary */
 		skb_reserve(skb, NET_IP_ALIGN);
 
-		page = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
-		if (!page) {
+		if (next_page == nr_pages) {
+			nr_pages = alloc_page_array(GFP_ATOMIC | __GFP_NOWARN,
+					min(batch_target - i, RX_PAGE_BATCH),
+					pages);
+			next_page = 0;
+		}
+		if (next_page == nr_pages) {
 			kfree_skb(skb);
 no_skb:
+			/* Give back pages left over from the last batch */
+			__free_page_array(pages + next_page,
+					  nr_pages - next_page);
 			/* Any skbuffs queued for refill? Force them out. */
 			if (i != 0)
 				goto refill;
@@ -260,6 +273,7 @@ no_skb:
 			break;
 		}
 
+		page = pages[next_page++];
 		skb_shinfo(skb)->frags[0].page = page;
 		skb_shinfo(skb)->nr_frags = 1;
 		__skb_queue_tail(&np->rx_batch, skb);
@@ -24,6 +24,7 @@
 #include <linux/file.h>
 #include <linux/mm.h>
 #include <linux/mman.h>
+#include <linux/pagemap.h>
 #include <linux/slab.h>
 #include <linux/timer.h>
 #include <linux/aio.h>
@@ -31,6 +32,11 @@
 #include <linux/workqueue.h>
 #include <linux/security.h>
 #include <linux/eventfd.h>
+#include <linux/kthread.h>
+#include <linux/fdtable.h>
+#include <linux/cred.h>
+#include <linux/capability.h>
+#include <linux/log2.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -42,6 +48,11 @@
 #define dprintk(x...)	do { ; } while (0)
 #endif
 
+#define IOCTX_FLAG_MASK		(IOCTX_FLAG_SQRING | IOCTX_FLAG_SQTHREAD)
+
+/* how long the submission ring poller spins before going to sleep */
+#define AIO_SQ_THREAD_IDLE	HZ
+
 /*------ sysctl variables----*/
 static DEFINE_SPINLOCK(aio_nr_lock);
 unsigned long aio_nr;		/* current system wide number of aio requests */
@@ -62,6 +73,7 @@ static LIST_HEAD(fput_head);
 
 static void aio_kick_handler(struct work_struct *);
 static void aio_queue_work(struct kioctx *);
+static int aio_sq_thread_start(struct kioctx *);
 
 /* aio_setup
  *	Creates the slab caches used by the aio routines, panic on
@@ -105,7 +117,10 @@ static int aio_setup_ring(struct kioctx *ctx)
 	struct aio_ring_info *info = &ctx->ring_info;
 	unsigned nr_events = ctx->max_reqs;
 	unsigned long size;
-	int nr_pages;
+	struct vm_area_struct *vma;
+	int nr_pages, sq_pages = 0;
+	int err = 0;
+	unsigned sq_nr = 0;
 
 	/* Compensate for the ring buffer's head/tail overlap entry */
 	nr_events += 2;	/* 1 is required, 2 for good luck */
@@ -119,6 +134,16 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	nr_events = (PAGE_SIZE * nr_pages - sizeof(struct aio_ring)) / sizeof(struct io_event);
 
+	/* the submission ring starts on the page after the last io_event */
+	if (ctx->flags & IOCTX_FLAG_SQRING) {
+		sq_nr = roundup_pow_of_two(ctx->max_reqs);
+		size = sizeof(struct aio_sq_ring);
+		size += sizeof(struct iocb) * sq_nr;
+		sq_pages = (size + PAGE_SIZE-1) >> PAGE_SHIFT;
+		info->sq_page = nr_pages;
+		nr_pages += sq_pages;
+	}
+
 	info->nr = 0;
 	info->ring_pages = info->internal_pages;
 	if (nr_pages > AIO_RING_PAGES) {
@@ -140,6 +165,25 @@ static int aio_setup_ring(struct kioctx *ctx)
 		return -EAGAIN;
 	}
 
+	/*
+	 * The kernel keeps using the pages pinned below: a copy-on-write
+	 * copy made by fork() would silently detach the parent's ring
+	 * writes from them, so the ring is not inherited at all.  The
+	 * mapping may have been merged with a neighbour, split it out first.
+	 */
+	vma = find_vma(ctx->mm, info->mmap_base);
+	if (vma->vm_start != info->mmap_base)
+		err = split_vma(ctx->mm, vma, info->mmap_base, 1);
+	if (!err && vma->vm_end != info->mmap_base + info->mmap_size)
+		err = split_vma(ctx->mm, vma,
+				info->mmap_base + info->mmap_size, 0);
+	if (err) {
+		up_write(&ctx->mm->mmap_sem);
+		aio_free_ring(ctx);
+		return -EAGAIN;
+	}
+	vma->vm_flags |= VM_DONTCOPY;
+
 	dprintk("mmap address: 0x%08lx\n", info->mmap_base);
 	info->nr_pages = get_user_pages(current, ctx->mm,
 					info->mmap_base, nr_pages, 
@@ -163,8 +207,23 @@ static int aio_setup_ring(struct kioctx *ctx)
 	ring->compat_features = AIO_RING_COMPAT_FEATURES;
 	ring->incompat_features = AIO_RING_INCOMPAT_FEATURES;
 	ring->header_length = sizeof(struct aio_ring);
+	if (sq_pages)
+		ring->compat_features |= AIO_RING_COMPAT_SQRING;
 	kunmap_atomic(ring, KM_USER0);
 
+	if (sq_pages) {
+		struct aio_sq_ring *sq;
+
+		info->sq_mask = sq_nr - 1;
+		info->sq_head = info->sq_tail = 0;
+
+		sq = kmap_atomic(info->ring_pages[info->sq_page], KM_USER0);
+		sq->head = sq->tail = 0;
+		sq->mask = sq_nr - 1;
+		sq->flags = 0;
+		kunmap_atomic(sq, KM_USER0);
+	}
+
 	return 0;
 }
 
@@ -217,6 +276,10 @@ static void __put_ioctx(struct kioctx *ctx)
 	cancel_delayed_work(&ctx->wq);
 	cancel_work_sync(&ctx->wq.work);
 	aio_free_ring(ctx);
+	if (ctx->sq_files)
+		put_files_struct(ctx->sq_files);
+	if (ctx->sq_cred)
+		put_cred(ctx->sq_cred);
 	mmdrop(ctx->mm);
 	ctx->mm = NULL;
 	pr_debug("__put_ioctx: freeing %p\n", ctx);
@@ -236,7 +299,7 @@ static void __put_ioctx(struct kioctx *ctx)
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned flags)
 {
 	struct mm_struct *mm;
 	struct kioctx *ctx;
@@ -257,6 +320,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 		return ERR_PTR(-ENOMEM);
 
 	ctx->max_reqs = nr_events;
+	ctx->flags = flags;
 	mm = ctx->mm = current->mm;
 	atomic_inc(&mm->mm_count);
 
@@ -268,6 +332,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
+	mutex_init(&ctx->sq_mutex);
+	init_waitqueue_head(&ctx->sq_wait);
 
 	if (aio_setup_ring(ctx) < 0)
 		goto out_freectx;
@@ -342,6 +408,18 @@ static void aio_cancel_all(struct kioctx *ctx)
 	spin_unlock_irq(&ctx->ctx_lock);
 }
 
+/* aio_sq_thread_stop
+ *	Stops the submission ring poller of a context, if it has one, so
+ *	that no new requests get submitted behind our back.
+ */
+static void aio_sq_thread_stop(struct kioctx *ctx)
+{
+	struct task_struct *tsk = xchg(&ctx->sq_thread, NULL);
+
+	if (tsk)
+		kthread_stop(tsk);
+}
+
 static void wait_for_all_aios(struct kioctx *ctx)
 {
 	struct task_struct *tsk = current;
@@ -396,6 +474,7 @@ void exit_aio(struct mm_struct *mm)
 		ctx = hlist_entry(mm->ioctx_list.first, struct kioctx, list);
 		hlist_del_rcu(&ctx->list);
 
+		aio_sq_thread_stop(ctx);
 		aio_cancel_all(ctx);
 
 		wait_for_all_aios(ctx);
@@ -547,7 +626,8 @@ static int __aio_put_req(struct kioctx *ctx, struct kiocb *req)
 	 * we would not be holding the last reference to the file*, so
 	 * this function will be executed w/out any aio kthread wakeup.
 	 */
-	if (unlikely(atomic_long_dec_and_test(&req->ki_filp->f_count))) {
+	if (unlikely(req->ki_filp &&
+		     atomic_long_dec_and_test(&req->ki_filp->f_count))) {
 		get_ioctx(ctx);
 		spin_lock(&fput_lock);
 		list_add(&req->ki_list, &fput_head);
@@ -1252,6 +1332,7 @@ static void io_destroy(struct kioctx *ioctx)
 	if (likely(!was_dead))
 		put_ioctx(ioctx);	/* twice for the list */
 
+	aio_sq_thread_stop(ioctx);
 	aio_cancel_all(ioctx);
 	wait_for_all_aios(ioctx);
 
@@ -1267,15 +1348,17 @@ static void io_destroy(struct kioctx *ioctx)
 /* sys_io_setup:
  *	Create an aio_context capable of receiving at least nr_events.
  *	ctxp must not point to an aio_context that already exists, and
- *	must be initialized to 0 prior to the call.  On successful
+ *	must be initialized to 0, or to a set of IOCTX_FLAG_* flags,
+ *	prior to the call.  On successful
  *	creation of the aio_context, *ctxp is filled in with the resulting 
  *	handle.  May fail with -EINVAL if *ctxp is not initialized,
  *	if the specified nr_events exceeds internal limits.  May fail 
  *	with -EAGAIN if the specified nr_events exceeds the user's limit 
  *	of available events.  May fail with -ENOMEM if insufficient kernel
  *	resources are available.  May fail with -EFAULT if an invalid
- *	pointer is passed for ctxp.  Will fail with -ENOSYS if not
- *	implemented.
+ *	pointer is passed for ctxp.  May fail with -EPERM if
+ *	IOCTX_FLAG_SQTHREAD is requested without CAP_SYS_ADMIN.  Will fail
+ *	with -ENOSYS if not implemented.
  */
 SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 {
@@ -1288,16 +1371,28 @@ SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 		goto out;
 
 	ret = -EINVAL;
-	if (unlikely(ctx || nr_events == 0)) {
+	if (unlikely((ctx & ~(unsigned long)IOCTX_FLAG_MASK) ||
+		     nr_events == 0)) {
 		pr_debug("EINVAL: io_setup: ctx %lu nr_events %u\n",
 		         ctx, nr_events);
 		goto out;
 	}
+	if (unlikely((ctx & IOCTX_FLAG_SQTHREAD) &&
+		     !(ctx & IOCTX_FLAG_SQRING)))
+		goto out;
+
+	ret = -EPERM;
+	if ((ctx & IOCTX_FLAG_SQTHREAD) && !capable(CAP_SYS_ADMIN))
+		goto out;
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, ctx);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
-		ret = put_user(ioctx->user_id, ctxp);
+		ret = 0;
+		if (ioctx->flags & IOCTX_FLAG_SQTHREAD)
+			ret = aio_sq_thread_start(ioctx);
+		if (!ret)
+			ret = put_user(ioctx->user_id, ctxp);
 		if (!ret)
 			return 0;
 
@@ -1349,6 +1444,98 @@ static void aio_advance_iovec(struct kiocb *iocb, ssize_t ret)
 	BUG_ON(ret > 0 && iocb->ki_left == 0);
 }
 
+/*
+ * aio_page_wake_function:
+ *	wait queue callback used while a buffered read waits for a page
+ *	to come out of I/O.  The page wait queues are hashed and shared
+ *	with PG_writeback waiters, so only the unlock of the page we are
+ *	waiting on (stashed in wait->private) triggers the retry.
+ */
+static int aio_page_wake_function(wait_queue_t *wait, unsigned mode,
+				  int sync, void *arg)
+{
+	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait);
+	struct wait_bit_key *key = arg;
+
+	if (!key || key->flags != wait->private || key->bit_nr != PG_locked)
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
+/*
+ * aio_buffered_read_ready:
+ *	Make sure a buffered read can be satisfied from the page cache
+ *	without sleeping on I/O.  The range is scanned from where the last
+ *	attempt stopped (ki_ready_pos) up to the first page that is missing
+ *	or not uptodate.  A missing page gets one readahead window started
+ *	for it, and a page still under read I/O has the iocb queued on its
+ *	wait queue: -EIOCBRETRY is returned, the unlock of the page kicks
+ *	the iocb and the scan resumes from that page, instead of io_submit()
+ *	sleeping in ->aio_read().
+ *
+ *	Returns 0 when ->aio_read() should be called now, either because
+ *	all pages are uptodate or because the fast path cannot help (page
+ *	allocation failed, a read error left a page !uptodate); the normal
+ *	synchronous path then deals with it.
+ */
+static ssize_t aio_buffered_read_ready(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct address_space *mapping = file->f_mapping;
+	struct page *page;
+	pgoff_t index, last_index;
+	loff_t isize, end;
+
+again:
+	isize = i_size_read(mapping->host);
+	if (!iocb->ki_left || iocb->ki_pos >= isize)
+		return 0;
+
+	end = min_t(loff_t, iocb->ki_pos + iocb->ki_left, isize);
+	index = max(iocb->ki_pos, iocb->ki_ready_pos) >> PAGE_CACHE_SHIFT;
+	last_index = (end - 1) >> PAGE_CACHE_SHIFT;
+
+	for (; index <= last_index; index++) {
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &file->f_ra, file,
+						  index, last_index - index + 1);
+			page = find_get_page(mapping, index);
+			if (!page)
+				return 0;
+		}
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, &file->f_ra, file,
+						   page, index,
+						   last_index - index + 1);
+		if (!PageUptodate(page))
+			break;
+		page_cache_release(page);
+	}
+
+	iocb->ki_ready_pos = (loff_t)index << PAGE_CACHE_SHIFT;
+	if (index > last_index)
+		return 0;
+
+	iocb->ki_wait.func = aio_page_wake_function;
+	iocb->ki_wait.private = &page->flags;
+	if (!add_page_unlock_waiter(page, &iocb->ki_wait)) {
+		page_cache_release(page);
+		return -EIOCBRETRY;
+	}
+
+	/* the read finished under us; carry on unless it failed */
+	if (PageUptodate(page)) {
+		page_cache_release(page);
+		goto again;
+	}
+	page_cache_release(page);
+	return 0;
+}
+
 static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1372,6 +1559,14 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	if (iocb->ki_pos < 0)
 		return -EINVAL;
 
+	/* don't block the submitter on page cache misses */
+	if (opcode == IOCB_CMD_PREADV && S_ISREG(inode->i_mode) &&
+	    !(file->f_flags & O_DIRECT) && mapping->a_ops->readpage) {
+		ret = aio_buffered_read_ready(iocb);
+		if (ret)
+			return ret;
+	}
+
 	do {
 		ret = rw_op(iocb, &iocb->ki_iovec[iocb->ki_cur_seg],
 			    iocb->ki_nr_segs - iocb->ki_cur_seg,
@@ -1629,6 +1824,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_obj.user = user_iocb;
 	req->ki_user_data = iocb->aio_data;
 	req->ki_pos = iocb->aio_offset;
+	req->ki_ready_pos = iocb->aio_offset;
 
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
 	req->ki_left = req->ki_nbytes = iocb->aio_nbytes;
@@ -1658,6 +1854,199 @@ out_put_req:
 	return ret;
 }
 
+/* aio_sq_ring_fail
+ *	Posts the completion event for a submission ring entry that could
+ *	not be submitted, so that every entry yields exactly one event.
+ *	Returns -EAGAIN if there is no room in the completion ring yet.
+ */
+static int aio_sq_ring_fail(struct kioctx *ctx, struct iocb __user *user_iocb,
+			    struct iocb *iocb, long res)
+{
+	struct kiocb *req;
+
+	req = aio_get_req(ctx);		/* returns with 2 references to req */
+	if (unlikely(!req))
+		return -EAGAIN;
+
+	req->ki_filp = NULL;
+	req->ki_obj.user = user_iocb;
+	req->ki_user_data = iocb->aio_data;
+	aio_complete(req, res, 0);
+	aio_put_req(req);		/* drop extra ref to req */
+	return 0;
+}
+
+static inline unsigned aio_sq_ring_tail(struct aio_ring_info *info)
+{
+	struct aio_sq_ring *sq;
+	unsigned tail;
+
+	sq = kmap_atomic(info->ring_pages[info->sq_page], KM_USER0);
+	tail = sq->tail;
+	kunmap_atomic(sq, KM_USER0);
+	return tail;
+}
+
+/* aio_sq_ring_submit
+ *	Submits the iocbs queued on the submission ring of ctx.  Entries
+ *	are copied straight out of the pinned ring pages, so there is no
+ *	per-iocb user pointer to fetch.  Stops early, leaving the rest of
+ *	the ring queued, when the completion ring has no room.  Returns
+ *	the number of entries consumed, or -EAGAIN if none could be.
+ */
+static long aio_sq_ring_submit(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_sq_ring *sq;
+	unsigned head, tail;
+	long ret = 0;
+	long i = 0;
+
+	mutex_lock(&ctx->sq_mutex);
+	head = info->sq_head;
+	tail = info->sq_tail = aio_sq_ring_tail(info);
+	smp_rmb();	/* read the entries only after the tail */
+
+	while (head != tail) {
+		unsigned long offset;
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+		void *p;
+
+		offset = sizeof(struct aio_sq_ring) +
+			 (head & info->sq_mask) * sizeof(struct iocb);
+		p = kmap_atomic(info->ring_pages[info->sq_page +
+						 (offset >> PAGE_SHIFT)],
+				KM_USER0);
+		memcpy(&tmp, p + (offset & ~PAGE_MASK), sizeof(tmp));
+		kunmap_atomic(p, KM_USER0);
+		user_iocb = (struct iocb __user *)(info->mmap_base +
+			((unsigned long)info->sq_page << PAGE_SHIFT) + offset);
+
+		ret = io_submit_one(ctx, user_iocb, &tmp);
+		if (unlikely(ret) && ret != -EAGAIN)
+			ret = aio_sq_ring_fail(ctx, user_iocb, &tmp, ret);
+		if (ret)
+			break;
+		head++;
+		i++;
+	}
+
+	if (i) {
+		info->sq_head = head;
+		sq = kmap_atomic(info->ring_pages[info->sq_page], KM_USER0);
+		smp_mb();	/* finish with the entries before freeing them */
+		sq->head = head;
+		kunmap_atomic(sq, KM_USER0);
+	}
+	mutex_unlock(&ctx->sq_mutex);
+
+	return i ? i : ret;
+}
+
+static void aio_sq_ring_set_flags(struct kioctx *ctx, unsigned flags)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_sq_ring *sq;
+
+	sq = kmap_atomic(info->ring_pages[info->sq_page], KM_USER0);
+	sq->flags = flags;
+	kunmap_atomic(sq, KM_USER0);
+	smp_mb();	/* pairs with user space writing tail, reading flags */
+}
+
+/* aio_sq_thread_submit
+ *	Drains the submission ring on behalf of the process which set up
+ *	the context: its mm, file table and credentials are borrowed for
+ *	the duration, as io_submit() would have run with them.
+ */
+static long aio_sq_thread_submit(struct kioctx *ctx)
+{
+	struct task_struct *tsk = current;
+	struct files_struct *files;
+	const struct cred *old_cred;
+	long ret;
+
+	if (aio_sq_ring_tail(&ctx->ring_info) == ctx->ring_info.sq_head)
+		return 0;
+
+	task_lock(tsk);
+	files = tsk->files;
+	tsk->files = ctx->sq_files;
+	task_unlock(tsk);
+	old_cred = override_creds(ctx->sq_cred);
+	use_mm(ctx->mm);
+
+	ret = aio_sq_ring_submit(ctx);
+
+	unuse_mm(ctx->mm);
+	revert_creds(old_cred);
+	task_lock(tsk);
+	tsk->files = files;
+	task_unlock(tsk);
+
+	return ret;
+}
+
+/* aio_sq_thread
+ *	Submission ring poller for IOCTX_FLAG_SQTHREAD contexts.  Keeps
+ *	polling the ring while there is work, and for AIO_SQ_THREAD_IDLE
+ *	after the last submission, then sets AIO_SQ_NEED_WAKEUP and sleeps
+ *	until io_submit(ctx, 0, NULL) wakes it up.
+ */
+static int aio_sq_thread(void *data)
+{
+	struct kioctx *ctx = data;
+	unsigned long timeout = jiffies + AIO_SQ_THREAD_IDLE;
+	DEFINE_WAIT(wait);
+
+	while (!kthread_should_stop()) {
+		if (aio_sq_thread_submit(ctx) > 0) {
+			timeout = jiffies + AIO_SQ_THREAD_IDLE;
+			cond_resched();
+			continue;
+		}
+
+		if (time_before(jiffies, timeout)) {
+			cpu_relax();
+			cond_resched();
+			continue;
+		}
+
+		/*
+		 * Entries we could not consume for lack of completion ring
+		 * space don't keep us awake: user space kicks us again.
+		 */
+		prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		aio_sq_ring_set_flags(ctx, AIO_SQ_NEED_WAKEUP);
+		if (aio_sq_ring_tail(&ctx->ring_info) == ctx->ring_info.sq_tail &&
+		    !kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+		aio_sq_ring_set_flags(ctx, 0);
+		timeout = jiffies + AIO_SQ_THREAD_IDLE;
+	}
+
+	return 0;
+}
+
+static int aio_sq_thread_start(struct kioctx *ctx)
+{
+	struct task_struct *tsk;
+
+	ctx->sq_files = get_files_struct(current);
+	ctx->sq_cred = get_current_cred();
+
+	tsk = kthread_create(aio_sq_thread, ctx, "aio_sq/%d",
+			     task_pid_nr(current));
+	if (IS_ERR(tsk))
+		return PTR_ERR(tsk);
+
+	ctx->sq_thread = tsk;
+	wake_up_process(tsk);
+	return 0;
+}
+
 /* sys_io_submit:
  *	Queue the nr iocbs pointed to by iocbpp for processing.  Returns
  *	the number of iocbs queued.  May return -EINVAL if the aio_context
@@ -1669,6 +2058,11 @@ out_put_req:
  *	iocb is invalid.  May fail with -EAGAIN if insufficient resources
  *	are available to queue any iocbs.  Will return 0 if nr is 0.  Will
  *	fail with -ENOSYS if not implemented.
+ *
+ *	On a context set up with IOCTX_FLAG_SQRING, nr == 0 instead submits
+ *	the iocbs queued on the submission ring and returns how many were
+ *	consumed, or wakes up the ring's polling thread (and returns 0)
+ *	with IOCTX_FLAG_SQTHREAD.
  */
 SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 		struct iocb __user * __user *, iocbpp)
@@ -1689,6 +2083,15 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 		return -EINVAL;
 	}
 
+	if (!nr && (ctx->flags & IOCTX_FLAG_SQRING)) {
+		if (ctx->flags & IOCTX_FLAG_SQTHREAD)
+			wake_up(&ctx->sq_wait);
+		else
+			ret = aio_sq_ring_submit(ctx);
+		put_ioctx(ctx);
+		return ret;
+	}
+
 	/*
 	 * AKPM: should this return a partial result if some of the IOs were
 	 * successfully submitted?
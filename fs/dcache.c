@@ -1417,6 +1417,42 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking a reference
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ *
+ * Like __d_lookup(), but neither d_lock nor a reference is taken on the
+ * result, which may be stale by the time it is returned.  The caller must
+ * hold rcu_read_lock(), must not use it on a parent with ->d_compare, and
+ * must validate whatever it concludes against rename_lock and, before
+ * keeping the dentry, re-check it is hashed under d_lock.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		if (dentry->d_name.hash != hash)
+			continue;
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		if (dentry->d_name.len != len)
+			continue;
+		if (memcmp(dentry->d_name.name, str, len))
+			continue;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -72,7 +72,11 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* Event bits that can be combined with EPOLLEXCLUSIVE */
+#define EP_EXCLUSIVE_OK_BITS (POLLIN | POLLOUT | POLLERR | POLLHUP | \
+			      EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -785,14 +789,31 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  * This is the callback that is passed to the wait queue wakeup
  * machanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * For EPOLLEXCLUSIVE items the return value tells the waker whether a
+ * task sleeping in epoll_wait() on this set was woken up, so that an
+ * exclusive wakeup moves on to the next epoll set when nobody here
+ * could have picked the event up.
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
+	int pwake = 0, ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
+	/*
+	 * If the item is already queued on the ready list (or on the
+	 * transfer list of an ep_scan_ready_list() that has not reached it
+	 * yet), its ->poll() will be called again before the event could be
+	 * lost, so a burst of events on one file costs a single round trip
+	 * through ep->lock.  The barrier orders the caller's state change
+	 * before the test, and pairs with the one in ep_send_events_proc().
+	 */
+	smp_mb();
+	if (ep_is_linked(&epi->rdllink))
+		return !(epi->event.events & EPOLLEXCLUSIVE);
+
 	spin_lock_irqsave(&ep->lock, flags);
 
 	/*
@@ -835,8 +856,10 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
 		wake_up_locked(&ep->wq);
+		ewake = 1;
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
@@ -847,7 +870,10 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
-	return 1;
+	if (!(epi->event.events & EPOLLEXCLUSIVE))
+		ewake = 1;
+
+	return ewake;
 }
 
 /*
@@ -864,7 +890,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1063,6 +1092,13 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 
 		list_del_init(&epi->rdllink);
 
+		/*
+		 * Pairs with the barrier in ep_poll_callback(): either the
+		 * callback sees the item unlinked and queues it again, or
+		 * the ->poll() below sees the new state.
+		 */
+		smp_mb();
+
 		revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL) &
 			epi->event.events;
 
@@ -1265,6 +1301,17 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * EPOLLEXCLUSIVE can only be set at EPOLL_CTL_ADD time, is not
+	 * allowed on nested epoll sets, and is only combined with the bits
+	 * for which a single wakeup makes sense.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD || is_file_epoll(tfile) ||
+		    (epds.events & ~EP_EXCLUSIVE_OK_BITS))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1297,8 +1344,11 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			/* the wait queue entries were added exclusive */
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
@@ -188,6 +188,8 @@ static int init_inodecache(void)
 
 static void destroy_inodecache(void)
 {
+	/* inodes are freed from RCU callbacks (FS_RCU_WALK) */
+	rcu_barrier();
 	kmem_cache_destroy(ext2_inode_cachep);
 }
 
@@ -1426,7 +1428,7 @@ static struct file_system_type ext2_fs_type = {
 	.name		= "ext2",
 	.get_sb		= ext2_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_WALK,
 };
 
 static int __init init_ext2_fs(void)
@@ -508,6 +508,8 @@ static int init_inodecache(void)
 
 static void destroy_inodecache(void)
 {
+	/* inodes are freed from RCU callbacks (FS_RCU_WALK) */
+	rcu_barrier();
 	kmem_cache_destroy(ext3_inode_cachep);
 }
 
@@ -2961,7 +2963,7 @@ static struct file_system_type ext3_fs_type = {
 	.name		= "ext3",
 	.get_sb		= ext3_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_WALK,
 };
 
 static int __init init_ext3_fs(void)
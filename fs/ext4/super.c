@@ -726,6 +726,8 @@ static int init_inodecache(void)
 
 static void destroy_inodecache(void)
 {
+	/* inodes are freed from RCU callbacks (FS_RCU_WALK) */
+	rcu_barrier();
 	kmem_cache_destroy(ext4_inode_cachep);
 }
 
@@ -3927,7 +3929,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.get_sb		= ext4_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_WALK,
 };
 
 #ifdef CONFIG_EXT4DEV_COMPAT
@@ -3946,7 +3948,7 @@ static struct file_system_type ext4dev_fs_type = {
 	.name		= "ext4dev",
 	.get_sb		= ext4dev_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_WALK,
 };
 MODULE_ALIAS("ext4dev");
 #endif
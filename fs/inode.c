@@ -225,6 +225,16 @@ static struct inode *alloc_inode(struct super_block *sb)
 	return NULL;
 }
 
+static void i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+
+	if (inode->i_sb->s_op->destroy_inode)
+		inode->i_sb->s_op->destroy_inode(inode);
+	else
+		kmem_cache_free(inode_cachep, (inode));
+}
+
 void destroy_inode(struct inode *inode)
 {
 	BUG_ON(inode_has_buffers(inode));
@@ -237,10 +247,16 @@ void destroy_inode(struct inode *inode)
 	if (inode->i_default_acl && inode->i_default_acl != ACL_NOT_CACHED)
 		posix_acl_release(inode->i_default_acl);
 #endif
-	if (inode->i_sb->s_op->destroy_inode)
-		inode->i_sb->s_op->destroy_inode(inode);
+	/*
+	 * Lockless path walks may still be looking at the inode through a
+	 * dentry they hold no reference on; generic_shutdown_super() and
+	 * the filesystems' module exit wait for these callbacks before the
+	 * superblock or the inode cache goes away.
+	 */
+	if (inode->i_sb->s_type->fs_flags & FS_RCU_WALK)
+		call_rcu(&inode->i_rcu, i_callback);
 	else
-		kmem_cache_free(inode_cachep, (inode));
+		i_callback(&inode->i_rcu);
 }
 EXPORT_SYMBOL(destroy_inode);
 
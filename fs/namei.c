@@ -459,6 +459,42 @@ ok:
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
+/*
+ * exec_permission_rcu() is exec_permission_lite() for the lockless walk:
+ * it must not sleep, and can only look at inodes of FS_RCU_WALK
+ * filesystems.  Those use generic_permission() with the VFS ACL cache,
+ * so the mode bits are authoritative when the inode is known to have
+ * no access ACL.  Returns -EAGAIN when the locked walk has to decide.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+	umode_t	mode = inode->i_mode;
+
+	if (inode->i_op->permission) {
+#ifdef CONFIG_FS_POSIX_ACL
+		if (IS_POSIXACL(inode) && ACCESS_ONCE(inode->i_acl) != NULL)
+			return -EAGAIN;
+#else
+		return -EAGAIN;
+#endif
+	}
+
+	if (current_fsuid() == inode->i_uid)
+		mode >>= 6;
+	else if (in_group_p(inode->i_gid))
+		mode >>= 3;
+
+	if (mode & MAY_EXEC)
+		goto ok;
+
+	if (capable(CAP_DAC_OVERRIDE) || capable(CAP_DAC_READ_SEARCH))
+		goto ok;
+
+	return -EAGAIN;
+ok:
+	return security_inode_exec_permission_rcu(inode);
+}
+
 /*
  * This is called when everything else fails, and we actually have
  * to go to the low-level filesystem to find out what we should do..
@@ -821,6 +857,105 @@ fail:
 	return PTR_ERR(dentry);
 }
 
+/*
+ * Lockless walk over the leading components of *namep.
+ *
+ * Starting at nd->path, walk through cached, positive, non-mountpoint
+ * directories of an FS_RCU_WALK filesystem under rcu_read_lock(), without
+ * touching d_lock, d_count or dcache_lock.  Anything unusual (".", "..",
+ * d_op, symlinks, mountpoints, cache misses, permission checks that need
+ * the filesystem or an LSM) ends the walk, and the last component is
+ * always left to the caller.  At the end, a reference is taken on the
+ * deepest directory reached, provided it is still hashed and no rename
+ * happened meanwhile; it then replaces nd->path.dentry and *namep is
+ * advanced past the walked components.
+ *
+ * Returns 0 if that happened, -EAGAIN if the locked walk has to carry on
+ * from where it is, which is always safe.
+ */
+static int rcu_link_path_walk(const char **namep, struct nameidata *nd)
+{
+	const char *name = *namep;
+	const char *walked = name;
+	struct dentry *parent = nd->path.dentry;
+	struct dentry *start = parent;
+	unsigned seq;
+
+	if (!(parent->d_sb->s_type->fs_flags & FS_RCU_WALK))
+		return -EAGAIN;
+
+	rcu_read_lock();
+	seq = read_seqbegin(&rename_lock);
+	for (;;) {
+		struct dentry *dentry;
+		struct inode *inode;
+		struct qstr this;
+		unsigned long hash;
+		const char *next;
+		unsigned int c;
+
+		inode = ACCESS_ONCE(parent->d_inode);
+		if (!inode || exec_permission_rcu(inode))
+			break;
+		if (parent->d_op)
+			break;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		/* leave the last component, and any slashes after it, alone */
+		if (!c)
+			break;
+		next = name;
+		while (*++next == '/');
+		if (!*next)
+			break;
+
+		if (this.name[0] == '.' && (this.len == 1 ||
+		    (this.len == 2 && this.name[1] == '.')))
+			break;
+
+		dentry = __d_lookup_rcu(parent, &this);
+		if (!dentry || dentry->d_op || d_mountpoint(dentry))
+			break;
+		inode = ACCESS_ONCE(dentry->d_inode);
+		if (!inode || !inode->i_op->lookup || inode->i_op->follow_link)
+			break;
+
+		parent = dentry;
+		name = walked = next;
+	}
+
+	if (parent == start)
+		goto fail;
+
+	spin_lock(&parent->d_lock);
+	if (d_unhashed(parent) || read_seqretry(&rename_lock, seq)) {
+		spin_unlock(&parent->d_lock);
+		goto fail;
+	}
+	atomic_inc(&parent->d_count);
+	spin_unlock(&parent->d_lock);
+	rcu_read_unlock();
+
+	dput(start);
+	nd->path.dentry = parent;
+	*namep = walked;
+	return 0;
+
+fail:
+	rcu_read_unlock();
+	return -EAGAIN;
+}
+
 /*
  * Name resolution.
  * This is the basic name resolution function, turning a pathname into
@@ -852,6 +987,9 @@ static int __link_path_walk(const char *name, struct nameidata *nd)
 		unsigned int c;
 
 		nd->flags |= LOOKUP_CONTINUE;
+		if (!(nd->flags & LOOKUP_REVAL) &&
+		    !rcu_link_path_walk(&name, nd))
+			inode = nd->path.dentry->d_inode;
 		err = exec_permission_lite(inode);
 		if (err == -EAGAIN)
 			err = inode_permission(nd->path.dentry->d_inode,
@@ -29,7 +29,6 @@
 #include <linux/fs.h>
 #include <linux/vfs.h>
 #include <linux/slab.h>
-#include <linux/mutex.h>
 #include <linux/string.h>
 #include <linux/buffer_head.h>
 #include <linux/zlib.h>
@@ -86,7 +85,8 @@ int squashfs_read_data(struct super_block *sb, void **buffer, u64 index,
 	struct buffer_head **bh;
 	int offset = index & ((1 << msblk->devblksize_log2) - 1);
 	u64 cur_index = index >> msblk->devblksize_log2;
-	int bytes, compressed, b = 0, k = 0, page = 0, avail;
+	int bytes, compressed, b = 0, k = 0, page = 0, avail, i;
+	struct squashfs_stream *stream;
 
 
 	bh = kcalloc((msblk->block_size >> msblk->devblksize_log2) + 1,
@@ -152,26 +152,35 @@ int squashfs_read_data(struct super_block *sb, void **buffer, u64 index,
 		ll_rw_block(READ, b - 1, bh + 1);
 	}
 
+	/*
+	 * Wait for all the reads to complete before grabbing a decompressor,
+	 * so a stream isn't held idle while waiting for I/O.
+	 */
+	for (i = 0; i < b; i++) {
+		wait_on_buffer(bh[i]);
+		if (!buffer_uptodate(bh[i]))
+			goto block_release;
+	}
+
 	if (compressed) {
 		int zlib_err = 0, zlib_init = 0;
+		z_stream *strm;
 
 		/*
 		 * Uncompress block.
 		 */
 
-		mutex_lock(&msblk->read_data_mutex);
+		stream = squashfs_get_stream(msblk);
+		strm = &stream->stream;
 
-		msblk->stream.avail_out = 0;
-		msblk->stream.avail_in = 0;
+		strm->avail_out = 0;
+		strm->avail_in = 0;
 
 		bytes = length;
 		do {
-			if (msblk->stream.avail_in == 0 && k < b) {
+			if (strm->avail_in == 0 && k < b) {
 				avail = min(bytes, msblk->devblksize - offset);
 				bytes -= avail;
-				wait_on_buffer(bh[k]);
-				if (!buffer_uptodate(bh[k]))
-					goto release_mutex;
 
 				if (avail == 0) {
 					offset = 0;
@@ -179,57 +188,51 @@ int squashfs_read_data(struct super_block *sb, void **buffer, u64 index,
 					continue;
 				}
 
-				msblk->stream.next_in = bh[k]->b_data + offset;
-				msblk->stream.avail_in = avail;
+				strm->next_in = bh[k]->b_data + offset;
+				strm->avail_in = avail;
 				offset = 0;
 			}
 
-			if (msblk->stream.avail_out == 0 && page < pages) {
-				msblk->stream.next_out = buffer[page++];
-				msblk->stream.avail_out = PAGE_CACHE_SIZE;
+			if (strm->avail_out == 0 && page < pages) {
+				strm->next_out = buffer[page++];
+				strm->avail_out = PAGE_CACHE_SIZE;
 			}
 
 			if (!zlib_init) {
-				zlib_err = zlib_inflateInit(&msblk->stream);
+				zlib_err = zlib_inflateInit(strm);
 				if (zlib_err != Z_OK) {
 					ERROR("zlib_inflateInit returned"
 						" unexpected result 0x%x,"
 						" srclength %d\n", zlib_err,
 						srclength);
-					goto release_mutex;
+					goto release_stream;
 				}
 				zlib_init = 1;
 			}
 
-			zlib_err = zlib_inflate(&msblk->stream, Z_SYNC_FLUSH);
+			zlib_err = zlib_inflate(strm, Z_SYNC_FLUSH);
 
-			if (msblk->stream.avail_in == 0 && k < b)
+			if (strm->avail_in == 0 && k < b)
 				put_bh(bh[k++]);
 		} while (zlib_err == Z_OK);
 
 		if (zlib_err != Z_STREAM_END) {
 			ERROR("zlib_inflate error, data probably corrupt\n");
-			goto release_mutex;
+			goto release_stream;
 		}
 
-		zlib_err = zlib_inflateEnd(&msblk->stream);
+		zlib_err = zlib_inflateEnd(strm);
 		if (zlib_err != Z_OK) {
 			ERROR("zlib_inflate error, data probably corrupt\n");
-			goto release_mutex;
+			goto release_stream;
 		}
-		length = msblk->stream.total_out;
-		mutex_unlock(&msblk->read_data_mutex);
+		length = strm->total_out;
+		squashfs_put_stream(msblk, stream);
 	} else {
 		/*
 		 * Block is uncompressed.
 		 */
-		int i, in, pg_offset = 0;
-
-		for (i = 0; i < b; i++) {
-			wait_on_buffer(bh[i]);
-			if (!buffer_uptodate(bh[i]))
-				goto block_release;
-		}
+		int in, pg_offset = 0;
 
 		for (bytes = length; k < b; k++) {
 			in = min(bytes, msblk->devblksize - offset);
@@ -255,8 +258,8 @@ int squashfs_read_data(struct super_block *sb, void **buffer, u64 index,
 	kfree(bh);
 	return length;
 
-release_mutex:
-	mutex_unlock(&msblk->read_data_mutex);
+release_stream:
+	squashfs_put_stream(msblk, stream);
 
 block_release:
 	for (; k < b; k++)
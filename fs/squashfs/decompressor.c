@@ -0,0 +1,180 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * decompressor.c
+ */
+
+/*
+ * This file implements the pool of zlib streams used to decompress blocks.
+ *
+ * A zlib stream (and its ~40K workspace) can only decompress one block at a
+ * time.  By default a filesystem has a pool of one stream, which serialises
+ * all decompression.  Mounting with "threads=multi" or "threads=<n>" raises
+ * the size of the pool, allowing processes reading different blocks to
+ * decompress them in parallel on different CPUs.  Streams beyond the first
+ * are allocated on demand, so the extra memory is only used if there is
+ * actually contention for the decompressor.
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/zlib.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+
+static struct squashfs_stream *squashfs_alloc_stream(void)
+{
+	struct squashfs_stream *stream = kmalloc(sizeof(*stream), GFP_KERNEL);
+
+	if (stream == NULL)
+		return NULL;
+
+	stream->stream.workspace = kmalloc(zlib_inflate_workspacesize(),
+		GFP_KERNEL);
+	if (stream->stream.workspace == NULL) {
+		kfree(stream);
+		return NULL;
+	}
+
+	return stream;
+}
+
+
+static void squashfs_free_stream(struct squashfs_stream *stream)
+{
+	kfree(stream->stream.workspace);
+	kfree(stream);
+}
+
+
+/*
+ * Initialise the decompressor pool with room for max streams.  One stream
+ * is allocated up front, so decompression can always make progress.
+ */
+int squashfs_decompressor_init(struct squashfs_sb_info *msblk, int max)
+{
+	struct squashfs_decompressor *decomp = &msblk->decomp;
+	struct squashfs_stream *stream;
+
+	spin_lock_init(&decomp->lock);
+	INIT_LIST_HEAD(&decomp->free);
+	init_waitqueue_head(&decomp->wait_queue);
+	decomp->max = max;
+
+	stream = squashfs_alloc_stream();
+	if (stream == NULL) {
+		ERROR("Failed to allocate zlib workspace\n");
+		return -ENOMEM;
+	}
+
+	list_add(&stream->list, &decomp->free);
+	decomp->avail = 1;
+	decomp->total = 1;
+
+	return 0;
+}
+
+
+/*
+ * Free all streams.  Must only be called when no decompression is in
+ * progress, i.e. at umount or on mount failure.
+ */
+void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_decompressor *decomp = &msblk->decomp;
+	struct squashfs_stream *stream;
+
+	while (!list_empty(&decomp->free)) {
+		stream = list_entry(decomp->free.next, struct squashfs_stream,
+			list);
+		list_del(&stream->list);
+		squashfs_free_stream(stream);
+	}
+
+	decomp->avail = decomp->total = 0;
+}
+
+
+/*
+ * Get an idle stream.  If all streams are in use and the pool isn't yet
+ * full, allocate another one, otherwise go to sleep waiting for one to be
+ * released.
+ */
+struct squashfs_stream *squashfs_get_stream(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_decompressor *decomp = &msblk->decomp;
+	struct squashfs_stream *stream;
+
+	while (1) {
+		spin_lock(&decomp->lock);
+
+		if (!list_empty(&decomp->free)) {
+			stream = list_entry(decomp->free.next,
+				struct squashfs_stream, list);
+			list_del(&stream->list);
+			decomp->avail--;
+			spin_unlock(&decomp->lock);
+			return stream;
+		}
+
+		if (decomp->total < decomp->max) {
+			decomp->total++;
+			spin_unlock(&decomp->lock);
+
+			stream = squashfs_alloc_stream();
+			if (stream)
+				return stream;
+
+			/*
+			 * Out of memory.  Not fatal, there is always at least
+			 * one stream, so wait for it to become available.
+			 */
+			spin_lock(&decomp->lock);
+			decomp->total--;
+		}
+
+		spin_unlock(&decomp->lock);
+		wait_event(decomp->wait_queue, decomp->avail);
+	}
+}
+
+
+/*
+ * Return stream to the pool, waking up anyone waiting for one.
+ */
+void squashfs_put_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *stream)
+{
+	struct squashfs_decompressor *decomp = &msblk->decomp;
+
+	spin_lock(&decomp->lock);
+	list_add(&stream->list, &decomp->free);
+	decomp->avail++;
+	spin_unlock(&decomp->lock);
+
+	wake_up(&decomp->wait_queue);
+}
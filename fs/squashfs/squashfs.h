@@ -36,6 +36,13 @@ static inline struct squashfs_inode_info *squashfs_i(struct inode *inode)
 extern int squashfs_read_data(struct super_block *, void **, u64, int, u64 *,
 				int, int);
 
+/* decompressor.c */
+extern int squashfs_decompressor_init(struct squashfs_sb_info *, int);
+extern void squashfs_decompressor_destroy(struct squashfs_sb_info *);
+extern struct squashfs_stream *squashfs_get_stream(struct squashfs_sb_info *);
+extern void squashfs_put_stream(struct squashfs_sb_info *,
+				struct squashfs_stream *);
+
 /* cache.c */
 extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
 extern void squashfs_cache_delete(struct squashfs_cache *);
@@ -35,6 +35,8 @@
 #include <linux/pagemap.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/parser.h>
+#include <linux/cpumask.h>
 #include <linux/zlib.h>
 #include <linux/magic.h>
 
@@ -66,6 +68,63 @@ static int supported_squashfs_filesystem(short major, short minor, short comp)
 }
 
 
+enum {
+	Opt_threads_single, Opt_threads_multi, Opt_threads, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_threads_single, "threads=single"},
+	{Opt_threads_multi, "threads=multi"},
+	{Opt_threads, "threads=%u"},
+	{Opt_err, NULL}
+};
+
+/*
+ * Parse the mount options.  The only option is the number of blocks that
+ * may be decompressed in parallel, which defaults to one.
+ */
+static int squashfs_parse_options(char *options, int *threads)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int option;
+
+	*threads = 1;
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, tokens, args)) {
+		case Opt_threads_single:
+			*threads = 1;
+			break;
+		case Opt_threads_multi:
+			*threads = min_t(int, num_online_cpus() * 2,
+					 SQUASHFS_MAX_THREADS);
+			break;
+		case Opt_threads:
+			if (match_int(&args[0], &option) || option < 1 ||
+					option > SQUASHFS_MAX_THREADS) {
+				ERROR("Invalid threads option \"%s\"\n", p);
+				return -EINVAL;
+			}
+			*threads = option;
+			break;
+		default:
+			ERROR("Unrecognized mount option \"%s\" "
+				"or missing value\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -76,10 +135,14 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	unsigned short flags;
 	unsigned int fragments;
 	u64 lookup_table_start;
-	int err;
+	int err, threads;
 
 	TRACE("Entered squashfs_fill_superblock\n");
 
+	err = squashfs_parse_options(data, &threads);
+	if (err)
+		return err;
+
 	sb->s_fs_info = kzalloc(sizeof(*msblk), GFP_KERNEL);
 	if (sb->s_fs_info == NULL) {
 		ERROR("Failed to allocate squashfs_sb_info\n");
@@ -87,12 +150,8 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	msblk = sb->s_fs_info;
 
-	msblk->stream.workspace = kmalloc(zlib_inflate_workspacesize(),
-		GFP_KERNEL);
-	if (msblk->stream.workspace == NULL) {
-		ERROR("Failed to allocate zlib workspace\n");
+	if (squashfs_decompressor_init(msblk, threads))
 		goto failure;
-	}
 
 	sblk = kzalloc(sizeof(*sblk), GFP_KERNEL);
 	if (sblk == NULL) {
@@ -103,7 +162,6 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
 	/*
@@ -210,8 +268,12 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
+	/*
+	 * Allocate read_page blocks, one per decompressor so that datablocks
+	 * can be filled in parallel
+	 */
+	msblk->read_page = squashfs_cache_init("data", threads,
+		msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
@@ -231,7 +293,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto allocate_lookup_table;
 
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		max(SQUASHFS_CACHED_FRAGMENTS, threads), msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -295,14 +357,14 @@ failed_mount:
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
-	kfree(msblk->stream.workspace);
+	squashfs_decompressor_destroy(msblk);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	kfree(sblk);
 	return err;
 
 failure:
-	kfree(msblk->stream.workspace);
+	squashfs_decompressor_destroy(msblk);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	return -ENOMEM;
@@ -349,7 +411,7 @@ static void squashfs_put_super(struct super_block *sb)
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
-		kfree(sbi->stream.workspace);
+		squashfs_decompressor_destroy(sbi);
 		kfree(sb->s_fs_info);
 		sb->s_fs_info = NULL;
 	}
@@ -321,6 +321,12 @@ void generic_shutdown_super(struct super_block *sb)
 		}
 		put_fs_excl();
 	}
+	/*
+	 * Let the deferred destroy_inode() calls finish, including those of
+	 * a mount that failed in fill_super after reading some inodes.
+	 */
+	if (sb->s_type->fs_flags & FS_RCU_WALK)
+		rcu_barrier();
 	spin_lock(&sb_lock);
 	/* should be initialized for __put_super_and_need_restart() */
 	list_del_init(&sb->s_list);
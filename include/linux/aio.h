@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
 
 #include <asm/atomic.h>
 
@@ -13,6 +14,8 @@
 #define AIO_KIOGRP_NR_ATOMIC	8
 
 struct kioctx;
+struct files_struct;
+struct cred;
 
 /* Notes on cancelling a kiocb:
  *	If a kiocb is cancelled, aio_complete may return 0 to indicate 
@@ -104,6 +107,7 @@ struct kiocb {
 	__u64			ki_user_data;	/* user's data for completion */
 	wait_queue_t		ki_wait;
 	loff_t			ki_pos;
+	loff_t			ki_ready_pos;	/* buffered read: cached below */
 
 	void			*private;
 	/* State that we remember to be able to restart/retry  */
@@ -145,6 +149,7 @@ struct kiocb {
 
 #define AIO_RING_MAGIC			0xa10a10a1
 #define AIO_RING_COMPAT_FEATURES	1
+#define AIO_RING_COMPAT_SQRING		2	/* struct aio_sq_ring follows */
 #define AIO_RING_INCOMPAT_FEATURES	0
 struct aio_ring {
 	unsigned	id;	/* kernel internal index number */
@@ -174,6 +179,12 @@ struct aio_ring_info {
 
 	unsigned		nr, tail;
 
+	/* submission ring, only with IOCTX_FLAG_SQRING */
+	unsigned		sq_page;	/* first page of the ring */
+	unsigned		sq_mask;
+	unsigned		sq_head;	/* trusted copy */
+	unsigned		sq_tail;	/* last tail seen */
+
 	struct page		*internal_pages[AIO_RING_PAGES];
 };
 
@@ -201,6 +212,14 @@ struct kioctx {
 
 	struct delayed_work	wq;
 
+	/* IOCTX_FLAG_* from io_setup() */
+	unsigned		flags;
+	struct mutex		sq_mutex;	/* serializes ring consumers */
+	wait_queue_head_t	sq_wait;
+	struct task_struct	*sq_thread;
+	struct files_struct	*sq_files;
+	const struct cred	*sq_cred;
+
 	struct rcu_head		rcu_head;
 };
 
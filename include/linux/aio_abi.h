@@ -54,6 +54,28 @@ enum {
  */
 #define IOCB_FLAG_RESFD		(1 << 0)
 
+/*
+ * Flags for io_setup(), passed in *ctxp in place of 0.
+ *
+ * IOCTX_FLAG_SQRING   - Map a submission ring (struct aio_sq_ring) right
+ *                       after the completion ring, at the first page
+ *                       boundary following its io_events.  Entries are
+ *                       submitted by io_submit(ctx, 0, NULL).
+ * IOCTX_FLAG_SQTHREAD - Also start a kernel thread that polls the
+ *                       submission ring, so that submission normally
+ *                       needs no system call.  Requires CAP_SYS_ADMIN.
+ */
+#define IOCTX_FLAG_SQRING	(1 << 0)
+#define IOCTX_FLAG_SQTHREAD	(1 << 1)
+
+/*
+ * Flags for the "flags" member of the "struct aio_sq_ring".
+ *
+ * AIO_SQ_NEED_WAKEUP - The polling thread went to sleep; user space must
+ *                      call io_submit(ctx, 0, NULL) after queueing iocbs.
+ */
+#define AIO_SQ_NEED_WAKEUP	(1 << 0)
+
 /* read() from /dev/aio returns these structures. */
 struct io_event {
 	__u64		data;		/* the data field from the iocb */
@@ -104,6 +126,27 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Submission ring shared with user space.  User space fills iocbs[tail &
+ * mask] and then advances tail; the kernel consumes entries from head and
+ * advances it once they have been submitted.  head and tail are free
+ * running.  Each consumed entry produces exactly one io_event, with obj
+ * pointing at the ring slot, so use aio_data to identify requests.
+ * Events can be reaped from the completion ring at the start of the
+ * mapping without io_getevents(), by advancing its head.
+ * The mapping is not inherited across fork(): it is absent in the child,
+ * and the parent keeps using it as before.
+ */
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by user space */
+	__u32	mask;		/* number of entries - 1 */
+	__u32	flags;		/* see AIO_SQ_ above */
+	__u32	reserved[12];
+
+	struct iocb	iocbs[0];
+}; /* 64 bytes + ring size */
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -172,6 +172,11 @@ struct inodes_stat_t {
 #define FS_REQUIRES_DEV 1 
 #define FS_BINARY_MOUNTDATA 2
 #define FS_HAS_SUBTYPE 4
+#define FS_RCU_WALK	8	/* Inodes are freed after an RCU grace period
+				 * and ->permission, if set, is
+				 * generic_permission() plus cached ACLs, so
+				 * path walks may look at them locklessly.
+				 */
 #define FS_REVAL_DOT	16384	/* Check the paths ".", ".." for staleness */
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
@@ -781,6 +786,8 @@ struct inode {
 	struct posix_acl	*i_default_acl;
 #endif
 	void			*i_private; /* fs or device private pointer */
+
+	struct rcu_head		i_rcu;	/* FS_RCU_WALK deferred free */
 };
 
 /*
@@ -36,6 +36,10 @@ struct vm_area_struct;
  *
  * __GFP_MOVABLE: Flag that this page will be movable by the page migration
  * mechanism or reclaimed
+ *
+ * __GFP_NO_KSWAPD: Don't wake kswapd when the allocation has to enter the
+ * slow path.  Used by opportunistic high-order allocations that have a
+ * small-page fallback.
  */
 #define __GFP_WAIT	((__force gfp_t)0x10u)	/* Can wait and reschedule? */
 #define __GFP_HIGH	((__force gfp_t)0x20u)	/* Should access emergency pools? */
@@ -59,13 +63,15 @@ struct vm_area_struct;
 #define __GFP_NOTRACK	((__force gfp_t)0)
 #endif
 
+#define __GFP_NO_KSWAPD	((__force gfp_t)0x400000u)
+
 /*
  * This may seem redundant, but it's a way of annotating false positives vs.
  * allocations that simply cannot be supported (e.g. page tables).
  */
 #define __GFP_NOTRACK_FALSE_POSITIVE (__GFP_NOTRACK)
 
-#define __GFP_BITS_SHIFT 22	/* Room for 22 __GFP_FOO bits */
+#define __GFP_BITS_SHIFT 23	/* Room for 23 __GFP_FOO bits */
 #define __GFP_BITS_MASK ((__force gfp_t)((1 << __GFP_BITS_SHIFT) - 1))
 
 /* This equals 0, but use constants in case they ever change */
@@ -83,6 +89,9 @@ struct vm_area_struct;
 #define GFP_HIGHUSER_MOVABLE	(__GFP_WAIT | __GFP_IO | __GFP_FS | \
 				 __GFP_HARDWALL | __GFP_HIGHMEM | \
 				 __GFP_MOVABLE)
+#define GFP_TRANSHUGE	(GFP_HIGHUSER_MOVABLE | __GFP_COMP | \
+			 __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN | \
+			 __GFP_NO_KSWAPD)
 
 #ifdef CONFIG_NUMA
 #define GFP_THISNODE	(__GFP_THISNODE | __GFP_NOWARN | __GFP_NORETRY)
@@ -311,6 +320,31 @@ extern struct page *alloc_page_vma(gfp_t gfp_mask,
 #endif
 #define alloc_page(gfp_mask) alloc_pages(gfp_mask, 0)
 
+extern unsigned long __alloc_page_array(gfp_t gfp_mask, unsigned long nr_pages,
+					struct page **page_array,
+					struct zonelist *zonelist,
+					nodemask_t *nodemask);
+
+static inline unsigned long alloc_page_array_node(int nid, gfp_t gfp_mask,
+						  unsigned long nr_pages,
+						  struct page **page_array)
+{
+	/* Unknown node is current node */
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_page_array(gfp_mask, nr_pages, page_array,
+				  node_zonelist(nid, gfp_mask), NULL);
+}
+
+#ifdef CONFIG_NUMA
+extern unsigned long alloc_page_array(gfp_t gfp_mask, unsigned long nr_pages,
+				      struct page **page_array);
+#else
+#define alloc_page_array(gfp_mask, nr_pages, page_array) \
+		alloc_page_array_node(numa_node_id(), gfp_mask, nr_pages, page_array)
+#endif
+
 extern unsigned long __get_free_pages(gfp_t gfp_mask, unsigned int order);
 extern unsigned long get_zeroed_page(gfp_t gfp_mask);
 
@@ -327,6 +361,7 @@ extern void __free_pages(struct page *page, unsigned int order);
 extern void free_pages(unsigned long addr, unsigned int order);
 extern void free_hot_page(struct page *page);
 extern void free_cold_page(struct page *page);
+extern void __free_page_array(struct page **pages, unsigned long nr_pages);
 
 #define __free_page(page) __free_pages((page), 0)
 #define free_page(addr) free_pages((addr),0)
@@ -55,6 +55,19 @@ struct tpacket_stats
 	unsigned int	tp_drops;
 };
 
+struct tpacket_stats_v3
+{
+	unsigned int	tp_packets;
+	unsigned int	tp_drops;
+	unsigned int	tp_freeze_q_cnt;
+};
+
+union tpacket_stats_u
+{
+	struct tpacket_stats	stats1;
+	struct tpacket_stats_v3	stats3;
+};
+
 struct tpacket_auxdata
 {
 	__u32		tp_status;
@@ -71,6 +84,7 @@ struct tpacket_auxdata
 #define TP_STATUS_COPY		0x2
 #define TP_STATUS_LOSING	0x4
 #define TP_STATUS_CSUMNOTREADY	0x8
+#define TP_STATUS_BLK_TMO	0x20
 
 /* Tx ring - header status */
 #define TP_STATUS_AVAILABLE	0x0
@@ -107,10 +121,72 @@ struct tpacket2_hdr
 
 #define TPACKET2_HDRLEN		(TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) + sizeof(struct sockaddr_ll))
 
+struct tpacket_hdr_variant1
+{
+	__u32		tp_rxhash;
+	__u32		tp_vlan_tci;
+};
+
+struct tpacket3_hdr
+{
+	__u32		tp_next_offset;
+	__u32		tp_sec;
+	__u32		tp_nsec;
+	__u32		tp_snaplen;
+	__u32		tp_len;
+	__u32		tp_status;
+	__u16		tp_mac;
+	__u16		tp_net;
+	/* pkt_hdr variants */
+	union {
+		struct tpacket_hdr_variant1 hv1;
+	};
+};
+
+#define TPACKET3_HDRLEN		(TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) + sizeof(struct sockaddr_ll))
+
+struct tpacket_bd_ts
+{
+	unsigned int	ts_sec;
+	union {
+		unsigned int	ts_usec;
+		unsigned int	ts_nsec;
+	};
+};
+
+struct tpacket_hdr_v1
+{
+	__u32		block_status;
+	__u32		num_pkts;
+	__u32		offset_to_first_pkt;
+	__u32		blk_len;	/* Bytes used, including padding */
+	__u64		seq_num __attribute__((aligned(8)));
+
+	/*
+	 * ts_first_pkt is the time the block was opened.  ts_last_pkt is
+	 * the time stamp of the last packet in the block, or the time the
+	 * block timed out if it holds no packets.
+	 */
+	struct tpacket_bd_ts	ts_first_pkt, ts_last_pkt;
+};
+
+union tpacket_bd_header_u
+{
+	struct tpacket_hdr_v1 bh1;
+};
+
+struct tpacket_block_desc
+{
+	__u32 version;
+	__u32 offset_to_priv;
+	union tpacket_bd_header_u hdr;
+};
+
 enum tpacket_versions
 {
 	TPACKET_V1,
 	TPACKET_V2,
+	TPACKET_V3,
 };
 
 /*
@@ -134,6 +210,23 @@ struct tpacket_req
 	unsigned int	tp_frame_nr;	/* Total number of frames */
 };
 
+struct tpacket_req3
+{
+	unsigned int	tp_block_size;	/* Minimal size of contiguous block */
+	unsigned int	tp_block_nr;	/* Number of blocks */
+	unsigned int	tp_frame_size;	/* Size of frame */
+	unsigned int	tp_frame_nr;	/* Total number of frames */
+	unsigned int	tp_retire_blk_tov; /* timeout in msecs */
+	unsigned int	tp_sizeof_priv; /* offset to private data area */
+	unsigned int	tp_feature_req_word;
+};
+
+union tpacket_req_u
+{
+	struct tpacket_req	req;
+	struct tpacket_req3	req3;
+};
+
 struct packet_mreq
 {
 	int		mr_ifindex;
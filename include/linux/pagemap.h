@@ -375,6 +375,7 @@ extern void end_page_writeback(struct page *page);
  * Add an arbitrary waiter to a page's wait queue
  */
 extern void add_page_wait_queue(struct page *page, wait_queue_t *waiter);
+extern int add_page_unlock_waiter(struct page *page, wait_queue_t *waiter);
 
 /*
  * Fault a userspace page into pagetables.  Return non-zero on a fault.
@@ -75,4 +75,14 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
 
 extern spinlock_t nf_conntrack_lock ;
 
+/*
+ * Insertion into and removal from the conntrack hash table are serialised
+ * by CONNTRACK_LOCKS locks, bucket i being protected by lock
+ * i % CONNTRACK_LOCKS.  nf_conntrack_lock nests outside of them.
+ */
+#define CONNTRACK_LOCKS 1024
+
+extern void nf_conntrack_bucket_lock(unsigned int bucket);
+extern void nf_conntrack_bucket_unlock(unsigned int bucket);
+
 #endif /* _NF_CONNTRACK_CORE_H */
@@ -45,6 +45,7 @@ struct Qdisc
 #define TCQ_F_BUILTIN		1
 #define TCQ_F_THROTTLED		2
 #define TCQ_F_INGRESS		4
+#define TCQ_F_NOLOCK		8
 #define TCQ_F_WARN_NONWC	(1 << 16)
 	int			padded;
 	struct Qdisc_ops	*ops;
@@ -72,6 +73,7 @@ struct Qdisc
 	 */
 	unsigned long		state;
 	struct sk_buff_head	q;
+	atomic_t		nolock_qlen;
 	struct gnet_stats_basic bstats;
 	struct gnet_stats_queue	qstats;
 };
@@ -192,6 +194,17 @@ static inline spinlock_t *qdisc_lock(struct Qdisc *qdisc)
 	return &qdisc->q.lock;
 }
 
+/* A TCQ_F_NOLOCK qdisc is enqueued to without the root lock held, and
+ * only ever dequeued from by the CPU owning __QDISC_STATE_RUNNING.  Its
+ * queue length is kept in nolock_qlen instead of q.qlen.
+ */
+static inline int qdisc_qlen(const struct Qdisc *q)
+{
+	if (q->flags & TCQ_F_NOLOCK)
+		return atomic_read(&q->nolock_qlen);
+	return q->q.qlen;
+}
+
 static inline struct Qdisc *qdisc_root(struct Qdisc *qdisc)
 {
 	return qdisc->dev_queue->qdisc;
@@ -325,7 +338,7 @@ static inline bool qdisc_all_tx_empty(const struct net_device *dev)
 		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
 		const struct Qdisc *q = txq->qdisc;
 
-		if (q->q.qlen)
+		if (qdisc_qlen(q))
 			return false;
 	}
 	return true;
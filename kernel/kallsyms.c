@@ -49,6 +49,8 @@ extern const u16 kallsyms_token_index[] __attribute__((weak));
 
 extern const unsigned long kallsyms_markers[] __attribute__((weak));
 
+extern const u8 kallsyms_seqs_of_names[] __attribute__((weak));
+
 static inline int is_kernel_inittext(unsigned long addr)
 {
 	if (addr >= (unsigned long)_sinittext
@@ -165,9 +167,57 @@ static unsigned int get_symbol_offset(unsigned long pos)
 	return name - kallsyms_names;
 }
 
+#ifdef CONFIG_KALLSYMS_NAME_INDEX
+/* Symbol index of the pos'th symbol in name order. */
+static unsigned long get_symbol_seq(unsigned long pos)
+{
+	const u8 *seq = &kallsyms_seqs_of_names[pos * 3];
+
+	return (seq[0] << 16) | (seq[1] << 8) | seq[2];
+}
+
+/*
+ * Binary search the name index.  Duplicate names are sorted by symbol
+ * index, so return the first one, as a linear scan would.
+ */
+static int kallsyms_lookup_name_index(const char *name, unsigned long *addr)
+{
+	char namebuf[KSYM_NAME_LEN];
+	unsigned long lo = 0, hi = kallsyms_num_syms, mid, seq;
+	int ret;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		seq = get_symbol_seq(mid);
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf);
+		ret = strcmp(name, namebuf);
+		if (ret > 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < kallsyms_num_syms) {
+		seq = get_symbol_seq(lo);
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf);
+		if (strcmp(name, namebuf) == 0) {
+			*addr = kallsyms_addresses[seq];
+			return 1;
+		}
+	}
+	return 0;
+}
+#endif
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
+#ifdef CONFIG_KALLSYMS_NAME_INDEX
+	unsigned long addr;
+
+	if (kallsyms_lookup_name_index(name, &addr))
+		return addr;
+#else
 	char namebuf[KSYM_NAME_LEN];
 	unsigned long i;
 	unsigned int off;
@@ -178,6 +228,7 @@ unsigned long kallsyms_lookup_name(const char *name)
 		if (strcmp(namebuf, name) == 0)
 			return kallsyms_addresses[i];
 	}
+#endif
 	return module_kallsyms_lookup_name(name);
 }
 
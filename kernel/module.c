@@ -54,6 +54,7 @@
 #include <linux/async.h>
 #include <linux/percpu.h>
 #include <linux/kmemleak.h>
+#include <linux/ktime.h>
 
 #if 0
 #define DEBUGP printk
@@ -192,28 +193,32 @@ extern const unsigned long __start___kcrctab_unused_gpl[];
 #define symversion(base, idx) ((base != NULL) ? ((base) + (idx)) : NULL)
 #endif
 
-static bool each_symbol_in_section(const struct symsearch *arr,
-				   unsigned int arrsize,
-				   struct module *owner,
-				   bool (*fn)(const struct symsearch *syms,
-					      struct module *owner,
-					      unsigned int symnum, void *data),
-				   void *data)
+static bool each_symbol_in_tables(const struct symsearch *arr,
+				  unsigned int arrsize,
+				  struct module *owner,
+				  bool (*fn)(const struct symsearch *syms,
+					     struct module *owner,
+					     void *data),
+				  void *data)
 {
-	unsigned int i, j;
+	unsigned int j;
 
 	for (j = 0; j < arrsize; j++) {
-		for (i = 0; i < arr[j].stop - arr[j].start; i++)
-			if (fn(&arr[j], owner, i, data))
-				return true;
+		if (fn(&arr[j], owner, data))
+			return true;
 	}
 
 	return false;
 }
 
-/* Returns true as soon as fn returns true, otherwise false. */
-bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
-			    unsigned int symnum, void *data), void *data)
+/*
+ * Call fn for each export table of the kernel and of every module.
+ * Returns true as soon as fn returns true, otherwise false.
+ */
+static bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
+					   struct module *owner,
+					   void *data),
+				void *data)
 {
 	struct module *mod;
 	const struct symsearch arr[] = {
@@ -235,7 +240,7 @@ bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
 #endif
 	};
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_tables(arr, ARRAY_SIZE(arr), NULL, fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
@@ -261,13 +266,66 @@ bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
 #endif
 		};
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
+		if (each_symbol_in_tables(arr, ARRAY_SIZE(arr), mod, fn, data))
 			return true;
 	}
 	return false;
 }
+
+struct each_symbol_arg {
+	bool (*fn)(const struct symsearch *arr, struct module *owner,
+		   unsigned int symnum, void *data);
+	void *data;
+};
+
+static bool each_symbol_in_section(const struct symsearch *syms,
+				   struct module *owner, void *data)
+{
+	struct each_symbol_arg *esa = data;
+	unsigned int i;
+
+	for (i = 0; i < syms->stop - syms->start; i++) {
+		if (esa->fn(syms, owner, i, esa->data))
+			return true;
+	}
+	return false;
+}
+
+/* Returns true as soon as fn returns true, otherwise false. */
+bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
+			    unsigned int symnum, void *data), void *data)
+{
+	struct each_symbol_arg esa = { .fn = fn, .data = data };
+
+	return each_symbol_section(each_symbol_in_section, &esa);
+}
 EXPORT_SYMBOL_GPL(each_symbol);
 
+/*
+ * Lookup a symbol in a range of kernel_symbols.  The export tables are
+ * sorted by name at link time (see EXPORT_SYMBOL and module-common.lds),
+ * so this is a binary search.
+ */
+static const struct kernel_symbol *lookup_symbol(const char *name,
+	const struct kernel_symbol *start,
+	const struct kernel_symbol *stop)
+{
+	size_t lo = 0, hi = stop - start;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(name, start[mid].name);
+
+		if (cmp < 0)
+			hi = mid;
+		else if (cmp > 0)
+			lo = mid + 1;
+		else
+			return &start[mid];
+	}
+	return NULL;
+}
+
 struct find_symbol_arg {
 	/* Input */
 	const char *name;
@@ -282,12 +340,16 @@ struct find_symbol_arg {
 
 static bool find_symbol_in_section(const struct symsearch *syms,
 				   struct module *owner,
-				   unsigned int symnum, void *data)
+				   void *data)
 {
 	struct find_symbol_arg *fsa = data;
+	const struct kernel_symbol *sym;
+	unsigned int symnum;
 
-	if (strcmp(syms->start[symnum].name, fsa->name) != 0)
+	sym = lookup_symbol(fsa->name, syms->start, syms->stop);
+	if (!sym)
 		return false;
+	symnum = sym - syms->start;
 
 	if (!fsa->gplok) {
 		if (syms->licence == GPL_ONLY)
@@ -318,7 +380,7 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 
 	fsa->owner = owner;
 	fsa->crc = symversion(syms->crcs, symnum);
-	fsa->sym = &syms->start[symnum];
+	fsa->sym = sym;
 	return true;
 }
 
@@ -336,7 +398,7 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol(find_symbol_in_section, &fsa)) {
+	if (each_symbol_section(find_symbol_in_section, &fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1573,6 +1635,9 @@ static int verify_export_symbols(struct module *mod)
 	return 0;
 }
 
+/* Time spent resolving module symbols since boot, under module_mutex. */
+static u64 symbol_resolve_ns;
+
 /* Change all symbols so that st_value encodes the pointer directly. */
 static int simplify_symbols(Elf_Shdr *sechdrs,
 			    unsigned int symindex,
@@ -1584,8 +1649,11 @@ static int simplify_symbols(Elf_Shdr *sechdrs,
 	Elf_Sym *sym = (void *)sechdrs[symindex].sh_addr;
 	unsigned long secbase;
 	unsigned int i, n = sechdrs[symindex].sh_size / sizeof(Elf_Sym);
+	unsigned int nundef = 0;
 	int ret = 0;
 	const struct kernel_symbol *ksym;
+	ktime_t start = ktime_get();
+	u64 delta;
 
 	for (i = 1; i < n; i++) {
 		switch (sym[i].st_shndx) {
@@ -1605,6 +1673,7 @@ static int simplify_symbols(Elf_Shdr *sechdrs,
 			break;
 
 		case SHN_UNDEF:
+			nundef++;
 			ksym = resolve_symbol(sechdrs, versindex,
 					      strtab + sym[i].st_name, mod);
 			/* Ok if resolved.  */
@@ -1633,6 +1702,12 @@ static int simplify_symbols(Elf_Shdr *sechdrs,
 		}
 	}
 
+	delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+	symbol_resolve_ns += delta;
+	pr_debug("%s: resolved %u symbols in %llu ns (%llu ns since boot)\n",
+		 mod->name, nundef, (unsigned long long)delta,
+		 (unsigned long long)symbol_resolve_ns);
+
 	return ret;
 }
 
@@ -1779,18 +1854,6 @@ static void setup_modinfo(struct module *mod, Elf_Shdr *sechdrs,
 
 #ifdef CONFIG_KALLSYMS
 
-/* lookup symbol in given range of kernel_symbols */
-static const struct kernel_symbol *lookup_symbol(const char *name,
-	const struct kernel_symbol *start,
-	const struct kernel_symbol *stop)
-{
-	const struct kernel_symbol *ks = start;
-	for (; ks < stop; ks++)
-		if (strcmp(ks->name, name) == 0)
-			return ks;
-	return NULL;
-}
-
 static int is_exported(const char *name, unsigned long value,
 		       const struct module *mod)
 {
@@ -50,6 +50,52 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 
 EXPORT_SYMBOL(jiffies_64);
 
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+/*
+ * Non-cascading timer wheel: LVL_DEPTH levels of LVL_SIZE buckets each,
+ * the buckets of level n being LVL_GRAN(n) jiffies wide.  A timer is
+ * queued on the first level whose range covers its timeout, in the bucket
+ * of its expiry time rounded up to the granularity of that level, and it
+ * stays there: when the wheel clock reaches a bucket, all of its timers
+ * are expired in one batch.  So a timer can fire up to one bucket late
+ * (at most about 1/8 of its timeout), but the work done per tick is
+ * bounded by LVL_DEPTH list splices instead of a cascade of whole
+ * buckets into the lower levels.
+ */
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* Nine levels cover about 12 days at HZ=1000, eight are enough at HZ=100 */
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+
+/* First timeout (in jiffies) queued on level n */
+#define LVL_START(n)	((LVL_SIZE - 1) << LVL_SHIFT((n) - 1))
+
+/* Longer timeouts are cut down to the range of the last level */
+#define WHEEL_TIMEOUT_CUTOFF	LVL_START(LVL_DEPTH)
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+
+struct tvec_base {
+	spinlock_t lock;
+	struct timer_list *running_timer;
+	unsigned long timer_jiffies;
+	struct list_head vectors[WHEEL_SIZE];
+} ____cacheline_aligned;
+#else
 /*
  * per-CPU timer vector definitions:
  */
@@ -78,6 +124,7 @@ struct tvec_base {
 	struct tvec tv4;
 	struct tvec tv5;
 } ____cacheline_aligned;
+#endif /* CONFIG_TIMER_WHEEL_NOCASCADE */
 
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
@@ -323,6 +370,116 @@ static inline void set_running_timer(struct tvec_base *base,
 #endif
 }
 
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+/*
+ * Does the bucket hold a timer at all, or with @wakeup one that has to
+ * wake up an idle CPU?
+ */
+static int bucket_has_timers(struct list_head *vec, int wakeup)
+{
+	struct timer_list *nte;
+
+	if (!wakeup)
+		return !list_empty(vec);
+
+	list_for_each_entry(nte, vec, entry) {
+		if (!tbase_get_deferrable(nte->base))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Timers fire when the wheel clock reaches their bucket, so the next
+ * event is the expiry time of the first non empty bucket on any level.
+ */
+static unsigned long next_bucket_expiry(struct tvec_base *base, int wakeup)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned long expires = clk + NEXT_TIMER_MAX_DELTA;
+	int lvl;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		/* first bucket of this level not yet expired */
+		unsigned long lvl_clk;
+		int i;
+
+		lvl_clk = (clk + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+		for (i = 0; i < LVL_SIZE; i++, lvl_clk++) {
+			unsigned long bucket_expiry = lvl_clk << LVL_SHIFT(lvl);
+
+			if (time_after_eq(bucket_expiry, expires))
+				break;
+			if (bucket_has_timers(base->vectors + LVL_OFFS(lvl) +
+					      (lvl_clk & LVL_MASK), wakeup)) {
+				expires = bucket_expiry;
+				break;
+			}
+		}
+	}
+	return expires;
+}
+
+/*
+ * The level of a new timer is picked from its distance to the wheel
+ * clock, which lags jiffies after a NO_HZ idle period or until the timer
+ * softirq catches up.  A short timer queued then would land on a coarse
+ * level and fire far more than 1/8 of its timeout late, so move the
+ * clock up to jiffies first, as far as no bucket in between holds timers.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = jiffies;
+	unsigned long next;
+
+	/* a few jiffies of lag do not change the level much */
+	if (time_before(jnow, base->timer_jiffies + LVL_CLK_DIV))
+		return;
+
+	next = next_bucket_expiry(base, 0);
+	if (time_before(next, jnow))
+		jnow = next;
+	if (time_after(jnow, base->timer_jiffies))
+		base->timer_jiffies = jnow;
+}
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long clk, delta, idx;
+	int lvl;
+
+	forward_timer_base(base);
+	clk = base->timer_jiffies;
+	delta = expires - clk;
+
+	if ((signed long) delta < 0) {
+		/*
+		 * Can happen if you add a timer with expires == jiffies,
+		 * or you set a timer to go off in the past
+		 */
+		idx = clk & LVL_MASK;
+	} else {
+		if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+			delta = WHEEL_TIMEOUT_MAX;
+			expires = clk + delta;
+		}
+		for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+			if (delta < LVL_START(lvl + 1))
+				break;
+		/*
+		 * Round up to the bucket granularity, the timer must
+		 * not fire early:
+		 */
+		expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+		idx = LVL_OFFS(lvl) + (expires & LVL_MASK);
+	}
+	/*
+	 * Timers are FIFO:
+	 */
+	list_add_tail(&timer->entry, base->vectors + idx);
+}
+#else
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
 	unsigned long expires = timer->expires;
@@ -364,6 +521,7 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 	 */
 	list_add_tail(&timer->entry, vec);
 }
+#endif /* CONFIG_TIMER_WHEEL_NOCASCADE */
 
 #ifdef CONFIG_TIMER_STATS
 void __timer_stats_timer_set_start_info(struct timer_list *timer, void *addr)
@@ -897,6 +1055,30 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+/*
+ * Move all the timers due at base->timer_jiffies to @work_list: the
+ * current bucket of level 0, and of each upper level whose clock ticks
+ * at the same time.
+ */
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *work_list)
+{
+	unsigned long clk = base->timer_jiffies;
+	int lvl;
+
+	INIT_LIST_HEAD(work_list);
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		list_splice_tail_init(base->vectors + LVL_OFFS(lvl) +
+				      (clk & LVL_MASK), work_list);
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+}
+#else
 static int cascade(struct tvec_base *base, struct tvec *tv, int index)
 {
 	/* cascade all the timers from tv up one level */
@@ -919,12 +1101,32 @@ static int cascade(struct tvec_base *base, struct tvec *tv, int index)
 
 #define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
 
+/*
+ * Move the timers due at base->timer_jiffies to @work_list, cascading
+ * the upper vectors down first when tv1 wraps.
+ */
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *work_list)
+{
+	int index = base->timer_jiffies & TVR_MASK;
+
+	/*
+	 * Cascade timers:
+	 */
+	if (!index &&
+		(!cascade(base, &base->tv2, INDEX(0))) &&
+			(!cascade(base, &base->tv3, INDEX(1))) &&
+				!cascade(base, &base->tv4, INDEX(2)))
+		cascade(base, &base->tv5, INDEX(3));
+	list_replace_init(base->tv1.vec + index, work_list);
+}
+#endif /* CONFIG_TIMER_WHEEL_NOCASCADE */
+
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects and executes all expired timer vectors.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
@@ -934,18 +1136,9 @@ static inline void __run_timers(struct tvec_base *base)
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
 		struct list_head work_list;
 		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		collect_expired_timers(base, head);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
@@ -1005,6 +1198,16 @@ static inline void __run_timers(struct tvec_base *base)
 }
 
 #ifdef CONFIG_NO_HZ
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+/*
+ * Find out when the next timer event is due to happen.
+ * This functions needs to be called disabled.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base)
+{
+	return next_bucket_expiry(base, 1);
+}
+#else
 /*
  * Find out when the next timer event is due to happen. This
  * is used on S/390 to stop all activity when a cpus is idle.
@@ -1079,6 +1282,7 @@ cascade:
 	}
 	return expires;
 }
+#endif /* CONFIG_TIMER_WHEEL_NOCASCADE */
 
 /*
  * Check, if the next hrtimer event is before the next timer wheel
@@ -1513,6 +1717,10 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+#else
 	for (j = 0; j < TVN_SIZE; j++) {
 		INIT_LIST_HEAD(base->tv5.vec + j);
 		INIT_LIST_HEAD(base->tv4.vec + j);
@@ -1521,6 +1729,7 @@ static int __cpuinit init_timers_cpu(int cpu)
 	}
 	for (j = 0; j < TVR_SIZE; j++)
 		INIT_LIST_HEAD(base->tv1.vec + j);
+#endif
 
 	base->timer_jiffies = jiffies;
 	return 0;
@@ -1557,6 +1766,10 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+#else
 	for (i = 0; i < TVR_SIZE; i++)
 		migrate_timer_list(new_base, old_base->tv1.vec + i);
 	for (i = 0; i < TVN_SIZE; i++) {
@@ -1565,6 +1778,7 @@ static void __cpuinit migrate_timers(int cpu)
 		migrate_timer_list(new_base, old_base->tv4.vec + i);
 		migrate_timer_list(new_base, old_base->tv5.vec + i);
 	}
+#endif
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -0,0 +1,295 @@
+/*
+ * Torture test for the timer wheel.
+ *
+ * Keeps a large number of timers armed with random timeouts, rearming
+ * each one from its own handler, and checks every expiry: no timer may
+ * run before its expires time, and none may run later than the wheel
+ * granularity allows (about 1/8 of its timeout with
+ * CONFIG_TIMER_WHEEL_NOCASCADE, plus late_slack jiffies of softirq
+ * delay).  The stats kthread prints two histograms: how late the
+ * handlers ran against the expiry asked for, which is mostly the wheel
+ * rounding it up to a bucket, and how late against the bucket itself,
+ * which is the latency of the timer softirq.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/moduleparam.h>
+#include <linux/vmalloc.h>
+#include <asm/atomic.h>
+
+MODULE_LICENSE("GPL");
+
+static int ntimers = 1000000;	/* # timers kept armed */
+static int max_timeout = 30000;	/* Longest random timeout, in ms. */
+static int late_slack = 2;	/* Allowed softirq delay, in jiffies. */
+static int stat_interval = 60;	/* Interval between stats, in seconds. */
+static int verbose;		/* Print every bad expiry. */
+
+module_param(ntimers, int, 0444);
+MODULE_PARM_DESC(ntimers, "Number of timers kept armed");
+module_param(max_timeout, int, 0444);
+MODULE_PARM_DESC(max_timeout, "Longest random timeout in milliseconds");
+module_param(late_slack, int, 0444);
+MODULE_PARM_DESC(late_slack, "Jiffies a timer may run late beyond the wheel granularity");
+module_param(stat_interval, int, 0444);
+MODULE_PARM_DESC(stat_interval, "Number of seconds between stats printk()s");
+module_param(verbose, bool, 0444);
+MODULE_PARM_DESC(verbose, "Report every early or late expiry");
+
+#define TORTURE_FLAG "timer-torture:"
+
+/* Lateness histogram: bucket 0 is on time, bucket n is [2^(n-1), 2^n) */
+#define TIMER_TORTURE_HIST_LEN 16
+
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+/* Level geometry of the wheel, as in kernel/timer.c */
+#define LVL_CLK_SHIFT	3
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+#define LVL_SIZE	64UL
+#define LVL_START(n)	((LVL_SIZE - 1) << LVL_SHIFT((n) - 1))
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+#endif
+
+struct timer_torture {
+	struct timer_list timer;
+	unsigned long armed;		/* jiffies when last armed */
+	unsigned long expires;		/* expiry asked for */
+	unsigned long bucket_expiry;	/* expiry of the bucket it went to */
+};
+
+static struct timer_torture *timer_tortures;
+static struct task_struct *stats_task;
+static int timer_torture_stopping;
+
+static DEFINE_PER_CPU(long [TIMER_TORTURE_HIST_LEN], timer_torture_hist);
+static DEFINE_PER_CPU(long [TIMER_TORTURE_HIST_LEN], timer_torture_softirq_hist);
+static DEFINE_PER_CPU(long, timer_torture_fired);
+static atomic_t n_timer_torture_early;
+static atomic_t n_timer_torture_late;
+static atomic_long_t timer_torture_max_late;
+static atomic_long_t timer_torture_max_softirq;
+
+/*
+ * Latest a timer queued @timeout jiffies ahead may run: the wheel rounds
+ * its expiry up to a bucket at most 8/63 of the timeout wide.
+ */
+static unsigned long timer_torture_late_limit(unsigned long timeout)
+{
+	return timeout / 7 + late_slack;
+}
+
+/*
+ * Expiry of the bucket the wheel queues a timer of @timeout jiffies in:
+ * the timer softirq runs it once the wheel clock reaches this time.  The
+ * level is picked from the distance to jiffies rather than to the wheel
+ * clock, which may lag a few jiffies, so this can come out one level
+ * finer than the wheel's choice and overstate the softirq latency, never
+ * understate it.
+ */
+static unsigned long timer_torture_bucket_expiry(unsigned long expires,
+						 unsigned long timeout)
+{
+#ifdef CONFIG_TIMER_WHEEL_NOCASCADE
+	int lvl;
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+		if (timeout < LVL_START(lvl + 1))
+			break;
+	return ((expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl)) <<
+		LVL_SHIFT(lvl);
+#else
+	/* the cascading wheel runs every timer in its own jiffy */
+	return expires;
+#endif
+}
+
+static void timer_torture_arm(struct timer_torture *tt)
+{
+	unsigned long timeout;
+
+	timeout = msecs_to_jiffies(random32() % max_timeout) + 1;
+	tt->armed = jiffies;
+	tt->expires = tt->armed + timeout;
+	tt->bucket_expiry = timer_torture_bucket_expiry(tt->expires, timeout);
+	mod_timer(&tt->timer, tt->expires);
+}
+
+static void timer_torture_update_max(atomic_long_t *maxp, long late)
+{
+	long max = atomic_long_read(maxp);
+
+	while (late > max) {
+		long old = atomic_long_cmpxchg(maxp, max, late);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+static void timer_torture_hist_add(long *hist, long late)
+{
+	int i;
+
+	for (i = 0; i < TIMER_TORTURE_HIST_LEN - 1 && late >> i; i++)
+		;
+	hist[i]++;
+}
+
+static void timer_torture_record(long late, long softirq)
+{
+	timer_torture_hist_add(__get_cpu_var(timer_torture_hist), late);
+	timer_torture_hist_add(__get_cpu_var(timer_torture_softirq_hist),
+			       softirq);
+	__get_cpu_var(timer_torture_fired)++;
+
+	timer_torture_update_max(&timer_torture_max_late, late);
+	timer_torture_update_max(&timer_torture_max_softirq, softirq);
+}
+
+static void timer_torture_fn(unsigned long data)
+{
+	struct timer_torture *tt = (struct timer_torture *)data;
+	unsigned long now = jiffies;
+	long late = now - tt->expires;
+	long softirq = now - tt->bucket_expiry;
+
+	if (late < 0) {
+		atomic_inc(&n_timer_torture_early);
+		if (verbose)
+			printk(KERN_ALERT TORTURE_FLAG
+			       "!!! timer ran %ld jiffies early\n", -late);
+		late = 0;
+	} else if (late > timer_torture_late_limit(tt->expires - tt->armed)) {
+		atomic_inc(&n_timer_torture_late);
+		if (verbose)
+			printk(KERN_ALERT TORTURE_FLAG
+			       "!!! timer of %lu jiffies ran %ld jiffies late\n",
+			       tt->expires - tt->armed, late);
+	}
+	if (softirq < 0)
+		softirq = 0;
+	timer_torture_record(late, softirq);
+
+	if (!ACCESS_ONCE(timer_torture_stopping))
+		timer_torture_arm(tt);
+}
+
+static void timer_torture_hist_print(const char *name, long *hist)
+{
+	int i;
+
+	printk(KERN_ALERT TORTURE_FLAG " %s:", name);
+	for (i = 0; i < TIMER_TORTURE_HIST_LEN - 1; i++)
+		printk(" <%uus: %ld", jiffies_to_usecs(1UL << i), hist[i]);
+	printk(" more: %ld\n", hist[i]);
+}
+
+static void timer_torture_stats_print(void)
+{
+	long hist[TIMER_TORTURE_HIST_LEN] = { 0 };
+	long softirq_hist[TIMER_TORTURE_HIST_LEN] = { 0 };
+	long fired = 0;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		for (i = 0; i < TIMER_TORTURE_HIST_LEN; i++) {
+			hist[i] += per_cpu(timer_torture_hist, cpu)[i];
+			softirq_hist[i] +=
+				per_cpu(timer_torture_softirq_hist, cpu)[i];
+		}
+		fired += per_cpu(timer_torture_fired, cpu);
+	}
+
+	printk(KERN_ALERT TORTURE_FLAG
+	       " ntimers: %d fired: %ld early: %d late: %d max late: %ld us%s\n",
+	       ntimers, fired, atomic_read(&n_timer_torture_early),
+	       atomic_read(&n_timer_torture_late),
+	       (long)jiffies_to_usecs(atomic_long_read(&timer_torture_max_late)),
+	       atomic_read(&n_timer_torture_early) ||
+	       atomic_read(&n_timer_torture_late) ? " !!! FAILURE" : "");
+	printk(KERN_ALERT TORTURE_FLAG " max softirq latency: %ld us\n",
+	       (long)jiffies_to_usecs(atomic_long_read(&timer_torture_max_softirq)));
+	timer_torture_hist_print("late", hist);
+	timer_torture_hist_print("softirq latency", softirq_hist);
+}
+
+static int timer_torture_stats(void *arg)
+{
+	do {
+		schedule_timeout_interruptible(stat_interval * HZ);
+		timer_torture_stats_print();
+	} while (!kthread_should_stop());
+	return 0;
+}
+
+static void timer_torture_cleanup(void)
+{
+	int i;
+
+	if (stats_task)
+		kthread_stop(stats_task);
+
+	timer_torture_stopping = 1;
+	smp_mb();
+	for (i = 0; i < ntimers; i++)
+		del_timer_sync(&timer_tortures[i].timer);
+
+	timer_torture_stats_print();
+	vfree(timer_tortures);
+}
+
+static int __init timer_torture_init(void)
+{
+	int i;
+
+	if (ntimers <= 0 || max_timeout <= 0 || late_slack < 0)
+		return -EINVAL;
+
+	timer_tortures = vmalloc(ntimers * sizeof(*timer_tortures));
+	if (!timer_tortures)
+		return -ENOMEM;
+
+	for (i = 0; i < ntimers; i++) {
+		struct timer_torture *tt = &timer_tortures[i];
+
+		setup_timer(&tt->timer, timer_torture_fn, (unsigned long)tt);
+		timer_torture_arm(tt);
+		if (!(i % 1024))
+			cond_resched();
+	}
+
+	if (stat_interval > 0) {
+		stats_task = kthread_run(timer_torture_stats, NULL,
+					 "timer_torture_stats");
+		if (IS_ERR(stats_task)) {
+			i = PTR_ERR(stats_task);
+			stats_task = NULL;
+			timer_torture_cleanup();
+			return i;
+		}
+	}
+	return 0;
+}
+
+module_init(timer_torture_init);
+module_exit(timer_torture_cleanup);
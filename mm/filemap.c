@@ -584,6 +584,39 @@ void add_page_wait_queue(struct page *page, wait_queue_t *waiter)
 }
 EXPORT_SYMBOL_GPL(add_page_wait_queue);
 
+/**
+ * add_page_unlock_waiter - queue a waiter for the unlocking of a page
+ * @page: the page
+ * @waiter: waiter to add to the page's wait queue
+ *
+ * Add @waiter to the wait queue of @page if, and only if, the page is
+ * still locked, so that its wake function is called from unlock_page().
+ * The waiter's wake function is responsible for dequeueing itself and
+ * should check the wait_bit_key it is handed, since the wait queues are
+ * shared with other pages and with PG_writeback waiters.
+ *
+ * Returns 0 if @waiter was queued, or -EAGAIN if the page was found
+ * unlocked, in which case @waiter is not left on the queue.
+ */
+int add_page_unlock_waiter(struct page *page, wait_queue_t *waiter)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&q->lock, flags);
+	__add_wait_queue_tail(q, waiter);
+	/* pairs with the barrier between clear_bit_unlock and the wakeup */
+	smp_mb();
+	if (!PageLocked(page)) {
+		__remove_wait_queue(q, waiter);
+		ret = -EAGAIN;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(add_page_unlock_waiter);
+
 /**
  * unlock_page - unlock a locked page
  * @page: the page
@@ -446,7 +446,12 @@ static inline int check_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd))
+		/*
+		 * hugetlbfs pmds would pass pmd_trans_huge() on x86, but
+		 * both callers leave hugetlb vmas to check_huge_range().
+		 */
+		split_huge_page_pmd(vma->vm_mm, pmd);
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		if (check_pte_range(vma, pmd, addr, next, nodes,
 				    flags, private))
@@ -1649,6 +1654,42 @@ struct page *alloc_pages_current(gfp_t gfp, unsigned order)
 }
 EXPORT_SYMBOL(alloc_pages_current);
 
+/**
+ * 	alloc_page_array - Allocate an array of order-0 pages.
+ *
+ *	@gfp: GFP flags, as for alloc_pages_current()
+ *	@nr_pages: number of pages wanted
+ *	@page_array: array the pages are stored in
+ *
+ *	Like calling alloc_pages_current() @nr_pages times, but batches the
+ *	per-cpu list accesses unless the current policy interleaves.
+ *	Returns the number of pages allocated; on a short count the caller
+ *	must free the pages it got.
+ */
+unsigned long alloc_page_array(gfp_t gfp, unsigned long nr_pages,
+			       struct page **page_array)
+{
+	struct mempolicy *pol = current->mempolicy;
+	unsigned long nr;
+
+	if (!pol || in_interrupt() || (gfp & __GFP_THISNODE))
+		pol = &default_policy;
+
+	if (pol->mode != MPOL_INTERLEAVE)
+		return __alloc_page_array(gfp, nr_pages, page_array,
+				policy_zonelist(gfp, pol),
+				policy_nodemask(gfp, pol));
+
+	for (nr = 0; nr < nr_pages; nr++) {
+		page_array[nr] = alloc_page_interleave(gfp, 0,
+						interleave_nodes(pol));
+		if (unlikely(!page_array[nr]))
+			break;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(alloc_page_array);
+
 /*
  * If mpol_dup() sees current->cpuset == cpuset_being_rebound, then it
  * rebinds the mempolicy its copying by calling mpol_rebind_policy()
@@ -100,7 +100,8 @@ static void remove_migration_pte(struct vm_area_struct *vma,
                 return;
 
 	pmd = pmd_offset(pud, addr);
-	if (!pmd_present(*pmd))
+	/* huge pmds, hugetlbfs ones included, hold no migration entries */
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
 		return;
 
 	ptep = pte_offset_map(pmd, addr);
@@ -174,7 +175,7 @@ static void remove_anon_migration_ptes(struct page *old, struct page *new)
 
 	mapping = (unsigned long)new->mapping;
 
-	if (!mapping || (mapping & PAGE_MAPPING_ANON) == 0)
+	if ((mapping & PAGE_MAPPING_FLAGS) != PAGE_MAPPING_ANON)
 		return;
 
 	/*
@@ -540,7 +541,8 @@ static int fallback_migrate_page(struct address_space *mapping,
  *   < 0 - error code
  *  == 0 - success
  */
-static int move_to_new_page(struct page *newpage, struct page *page)
+static int move_to_new_page(struct page *newpage, struct page *page,
+						int remap_swapcache)
 {
 	struct address_space *mapping;
 	int rc;
@@ -576,7 +578,8 @@ static int move_to_new_page(struct page *newpage, struct page *page)
 		rc = fallback_migrate_page(mapping, newpage, page);
 
 	if (!rc) {
-		remove_migration_ptes(page, newpage);
+		if (remap_swapcache)
+			remove_migration_ptes(page, newpage);
 	} else
 		newpage->mapping = NULL;
 
@@ -596,6 +599,7 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	int *result = NULL;
 	struct page *newpage = get_new_page(page, private, &result);
 	int rcu_locked = 0;
+	int remap_swapcache = 1;
 	int charge = 0;
 	struct mem_cgroup *mem;
 
@@ -616,6 +620,10 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 		lock_page(page);
 	}
 
+	/* Pages are migrated one small page at a time */
+	if (unlikely(PageTransHuge(page)) && unlikely(split_huge_page(page)))
+		goto unlock;
+
 	/* charge against new page */
 	charge = mem_cgroup_prepare_migration(page, &mem);
 	if (charge == -ENOMEM) {
@@ -640,6 +648,19 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	if (PageAnon(page)) {
 		rcu_read_lock();
 		rcu_locked = 1;
+
+		/*
+		 * Compaction can pick up any page on the LRU.  An unmapped
+		 * anonymous page is about to be freed and its anon_vma may
+		 * already be gone, so leave it alone.  An unmapped swapcache
+		 * page gets migrated, but its anon_vma cannot be trusted to
+		 * remap it if migration fails: see remove_migration_ptes().
+		 */
+		if (!page_mapped(page)) {
+			if (!PageSwapCache(page))
+				goto rcu_unlock;
+			remap_swapcache = 0;
+		}
 	}
 
 	/*
@@ -672,9 +693,9 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	try_to_unmap(page, 1);
 
 	if (!page_mapped(page))
-		rc = move_to_new_page(newpage, page);
+		rc = move_to_new_page(newpage, page, remap_swapcache);
 
-	if (rc)
+	if (rc && remap_swapcache)
 		remove_migration_ptes(page, page);
 rcu_unlock:
 	if (rcu_locked)
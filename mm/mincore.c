@@ -12,6 +12,7 @@
 #include <linux/mm.h>
 #include <linux/mman.h>
 #include <linux/syscalls.h>
+#include <linux/hugetlb.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
 
@@ -88,6 +89,23 @@ static long do_mincore(unsigned long addr, unsigned char *vec, unsigned long pag
 	 */
 	nr = min(nr, pages);
 
+#ifdef CONFIG_HUGETLB_PAGE
+	/*
+	 * hugetlbfs pmds are huge too and pass pmd_trans_huge() on x86, but
+	 * may not be present: look their ptes up the hugetlb way instead.
+	 */
+	if (is_vm_hugetlb_page(vma)) {
+		struct hstate *h = hstate_vma(vma);
+
+		for (i = 0; i < nr; i++, addr += PAGE_SIZE) {
+			ptep = huge_pte_offset(vma->vm_mm,
+					       addr & huge_page_mask(h));
+			vec[i] = ptep && !huge_pte_none(huge_ptep_get(ptep));
+		}
+		return nr;
+	}
+#endif
+
 	pgd = pgd_offset(vma->vm_mm, addr);
 	if (pgd_none_or_clear_bad(pgd))
 		goto none_mapped;
@@ -95,7 +113,13 @@ static long do_mincore(unsigned long addr, unsigned char *vec, unsigned long pag
 	if (pud_none_or_clear_bad(pud))
 		goto none_mapped;
 	pmd = pmd_offset(pud, addr);
-	if (pmd_none_or_clear_bad(pmd))
+	if (pmd_trans_huge(*pmd)) {
+		/* nr never crosses the pmd: the huge page maps it all */
+		for (i = 0; i < nr; i++)
+			vec[i] = 1;
+		return nr;
+	}
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 		goto none_mapped;
 
 	ptep = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
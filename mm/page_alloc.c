@@ -48,6 +48,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
 #include <linux/kmemleak.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -561,6 +562,8 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 
 	kmemcheck_free_shadow(page, order);
 
+	if (PageAnon(page))
+		page->mapping = NULL;
 	for (i = 0 ; i < (1 << order) ; ++i)
 		bad += free_pages_check(page + i);
 	if (bad)
@@ -1017,21 +1020,17 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Checks and debug hooks run on an order-0 page before it goes back to
+ * a per-cpu list.  Returns 1 if the page is bad and must not be freed.
  */
-static void free_hot_cold_page(struct page *page, int cold)
+static inline int free_pcp_prepare(struct page *page)
 {
-	struct zone *zone = page_zone(page);
-	struct per_cpu_pages *pcp;
-	unsigned long flags;
-	int wasMlocked = TestClearPageMlocked(page);
-
 	kmemcheck_free_shadow(page, 0);
 
 	if (PageAnon(page))
 		page->mapping = NULL;
 	if (free_pages_check(page))
-		return;
+		return 1;
 
 	if (!PageHighMem(page)) {
 		debug_check_no_locks_freed(page_address(page), PAGE_SIZE);
@@ -1039,6 +1038,21 @@ static void free_hot_cold_page(struct page *page, int cold)
 	}
 	arch_free_page(page, 0);
 	kernel_map_pages(page, 1, 0);
+	return 0;
+}
+
+/*
+ * Free a 0-order page
+ */
+static void free_hot_cold_page(struct page *page, int cold)
+{
+	struct zone *zone = page_zone(page);
+	struct per_cpu_pages *pcp;
+	unsigned long flags;
+	int wasMlocked = TestClearPageMlocked(page);
+
+	if (free_pcp_prepare(page))
+		return;
 
 	pcp = &zone_pcp(zone, get_cpu())->pcp;
 	set_page_private(page, get_pageblock_migratetype(page));
@@ -1098,6 +1112,95 @@ void split_page(struct page *page, unsigned int order)
 		set_page_refcounted(page + i);
 }
 
+#ifdef CONFIG_COMPACTION
+/*
+ * Similar to split_page except the page is already free. As this is only
+ * being used for migration, the migratetype of the block also changes.
+ * As this is called with interrupts disabled, the caller is responsible
+ * for calling arch_alloc_page() and kernel_map_page() after interrupts
+ * are enabled.
+ *
+ * Note: this is probably too low level an operation for use in drivers.
+ * Please consult with lkml before using this in your driver.
+ */
+int split_free_page(struct page *page)
+{
+	unsigned int order;
+	unsigned long watermark;
+	struct zone *zone;
+
+	BUG_ON(!PageBuddy(page));
+
+	zone = page_zone(page);
+	order = page_order(page);
+
+	/* Obey watermarks as if the page was being allocated */
+	watermark = low_wmark_pages(zone) + (1 << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return 0;
+
+	/* Remove page from free list */
+	list_del(&page->lru);
+	zone->free_area[order].nr_free--;
+	rmv_page_order(page);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+	/* Split into individual pages */
+	set_page_refcounted(page);
+	split_page(page, order);
+
+	if (order >= pageblock_order - 1) {
+		struct page *endpage = page + (1 << order) - 1;
+		for (; page < endpage; page += pageblock_nr_pages)
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+
+	return 1 << order;
+}
+#endif
+
+/*
+ * Take an order-0 page of the given migratetype off a per-cpu list,
+ * refilling the list from the buddy allocator when needed.  Must be
+ * called with interrupts disabled.
+ */
+static inline struct page *rmqueue_pcp(struct zone *zone,
+			struct per_cpu_pages *pcp, int migratetype, int cold)
+{
+	struct page *page;
+
+	if (!pcp->count) {
+		pcp->count = rmqueue_bulk(zone, 0,
+				pcp->batch, &pcp->list,
+				migratetype, cold);
+		if (unlikely(!pcp->count))
+			return NULL;
+	}
+
+	/* Find a page of the appropriate migrate type */
+	if (cold) {
+		list_for_each_entry_reverse(page, &pcp->list, lru)
+			if (page_private(page) == migratetype)
+				break;
+	} else {
+		list_for_each_entry(page, &pcp->list, lru)
+			if (page_private(page) == migratetype)
+				break;
+	}
+
+	/* Allocate more to the pcp list if necessary */
+	if (unlikely(&page->lru == &pcp->list)) {
+		pcp->count += rmqueue_bulk(zone, 0,
+				pcp->batch, &pcp->list,
+				migratetype, cold);
+		page = list_entry(pcp->list.next, struct page, lru);
+	}
+
+	list_del(&page->lru);
+	pcp->count--;
+	return page;
+}
+
 /*
  * Really, prep_compound_page() should be called from __rmqueue_bulk().  But
  * we cheat by calling it from here, in the order > 0 path.  Saves a branch
@@ -1120,35 +1223,9 @@ again:
 
 		pcp = &zone_pcp(zone, cpu)->pcp;
 		local_irq_save(flags);
-		if (!pcp->count) {
-			pcp->count = rmqueue_bulk(zone, 0,
-					pcp->batch, &pcp->list,
-					migratetype, cold);
-			if (unlikely(!pcp->count))
-				goto failed;
-		}
-
-		/* Find a page of the appropriate migrate type */
-		if (cold) {
-			list_for_each_entry_reverse(page, &pcp->list, lru)
-				if (page_private(page) == migratetype)
-					break;
-		} else {
-			list_for_each_entry(page, &pcp->list, lru)
-				if (page_private(page) == migratetype)
-					break;
-		}
-
-		/* Allocate more to the pcp list if necessary */
-		if (unlikely(&page->lru == &pcp->list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, &pcp->list,
-					migratetype, cold);
-			page = list_entry(pcp->list.next, struct page, lru);
-		}
-
-		list_del(&page->lru);
-		pcp->count--;
+		page = rmqueue_pcp(zone, pcp, migratetype, cold);
+		if (unlikely(!page))
+			goto failed;
 	} else {
 		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
 			/*
@@ -1187,6 +1264,49 @@ failed:
 	return NULL;
 }
 
+/*
+ * Upper bound on the pages the page array functions move to or from the
+ * per-cpu lists in a single interrupts-disabled section.
+ */
+#define PAGE_ARRAY_BATCH	64
+
+/*
+ * Like buffered_rmqueue() for order 0, but takes up to nr_pages pages
+ * off the per-cpu list of one zone with interrupts disabled only once.
+ * Returns the number of pages stored at page_array.
+ */
+static unsigned long rmqueue_pcp_array(struct zone *preferred_zone,
+			struct zone *zone, gfp_t gfp_flags, int migratetype,
+			unsigned long nr_pages, struct page **page_array)
+{
+	struct per_cpu_pages *pcp;
+	unsigned long flags;
+	unsigned long i, nr, good;
+	int cold = !!(gfp_flags & __GFP_COLD);
+
+	pcp = &zone_pcp(zone, get_cpu())->pcp;
+	local_irq_save(flags);
+	for (nr = 0; nr < nr_pages; nr++) {
+		struct page *page = rmqueue_pcp(zone, pcp, migratetype, cold);
+
+		if (unlikely(!page))
+			break;
+		zone_statistics(preferred_zone, zone);
+		page_array[nr] = page;
+	}
+	__count_zone_vm_events(PGALLOC, zone, nr);
+	local_irq_restore(flags);
+	put_cpu();
+
+	/* Bad pages are dropped, just as buffered_rmqueue() drops them */
+	for (i = 0, good = 0; i < nr; i++) {
+		VM_BUG_ON(bad_range(zone, page_array[i]));
+		if (!prep_new_page(page_array[i], 0, gfp_flags))
+			page_array[good++] = page_array[i];
+	}
+	return good;
+}
+
 /* The ALLOC_WMARK bits are used as an index to zone->watermark */
 #define ALLOC_WMARK_MIN		WMARK_MIN
 #define ALLOC_WMARK_LOW		WMARK_LOW
@@ -1610,6 +1730,67 @@ out:
 	return page;
 }
 
+#ifdef CONFIG_COMPACTION
+/* Try memory compaction for high-order allocations before reclaim */
+static struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags, struct zone *preferred_zone,
+	int migratetype)
+{
+	struct page *page;
+	unsigned long compact_result;
+	struct task_struct *p = current;
+
+	if (!order || compaction_deferred(preferred_zone))
+		return NULL;
+
+	/* Migration may allocate: don't let it recurse into compaction */
+	p->flags |= PF_MEMALLOC;
+	compact_result = try_to_compact_pages(zonelist, order, gfp_mask,
+								nodemask);
+	p->flags &= ~PF_MEMALLOC;
+
+	if (compact_result == COMPACT_SKIPPED)
+		return NULL;
+
+	/* Page migration frees to the PCP lists but we want merging */
+	drain_pages(get_cpu());
+	put_cpu();
+
+	page = get_page_from_freelist(gfp_mask, nodemask,
+			order, zonelist, high_zoneidx,
+			alloc_flags, preferred_zone,
+			migratetype);
+	if (page) {
+		preferred_zone->compact_considered = 0;
+		preferred_zone->compact_defer_shift = 0;
+		count_vm_event(COMPACTSUCCESS);
+		return page;
+	}
+
+	/*
+	 * It's bad if compaction run occurs and fails.
+	 * The most likely reason is that pages exist,
+	 * but not enough to satisfy watermarks.
+	 */
+	count_vm_event(COMPACTFAIL);
+	defer_compaction(preferred_zone);
+
+	cond_resched();
+	return NULL;
+}
+#else
+static inline struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags, struct zone *preferred_zone,
+	int migratetype)
+{
+	return NULL;
+}
+#endif /* CONFIG_COMPACTION */
+
 /* The really slow allocator path where we enter direct reclaim */
 static inline struct page *
 __alloc_pages_direct_reclaim(gfp_t gfp_mask, unsigned int order,
@@ -1761,7 +1942,8 @@ __alloc_pages_slowpath(gfp_t gfp_mask, unsigned int order,
 	if (NUMA_BUILD && (gfp_mask & GFP_THISNODE) == GFP_THISNODE)
 		goto nopage;
 
-	wake_all_kswapd(order, zonelist, high_zoneidx);
+	if (!(gfp_mask & __GFP_NO_KSWAPD))
+		wake_all_kswapd(order, zonelist, high_zoneidx);
 
 	/*
 	 * OK, we're below the kswapd watermark and have kicked background
@@ -1800,6 +1982,18 @@ rebalance:
 	if (test_thread_flag(TIF_MEMDIE) && !(gfp_mask & __GFP_NOFAIL))
 		goto nopage;
 
+	/*
+	 * Try direct compaction: for a high-order request, assembling a
+	 * free block out of movable pages is cheaper than reclaiming it.
+	 */
+	page = __alloc_pages_direct_compact(gfp_mask, order,
+					zonelist, high_zoneidx,
+					nodemask,
+					alloc_flags, preferred_zone,
+					migratetype);
+	if (page)
+		goto got_pg;
+
 	/* Try direct reclaim and then allocating */
 	page = __alloc_pages_direct_reclaim(gfp_mask, order,
 					zonelist, high_zoneidx,
@@ -1909,6 +2103,81 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/**
+ * __alloc_page_array - allocate an array of order-0 pages
+ * @gfp_mask: GFP flags for the allocation
+ * @nr_pages: number of pages wanted
+ * @page_array: array the pages are stored in
+ * @zonelist: zonelist to allocate from
+ * @nodemask: nodes allowed, or NULL for all
+ *
+ * Pages are taken off the per-cpu list of the preferred zone in batches,
+ * with interrupts disabled once per batch, for as long as that zone stays
+ * above its low watermark.  The rest is left to __alloc_pages_nodemask()
+ * one page at a time, so reclaim and fallback behave as for alloc_page().
+ *
+ * Returns the number of pages stored at the start of @page_array.  This
+ * is less than @nr_pages only if the allocation failed, in which case
+ * the caller still owns and must free the pages it got.
+ */
+unsigned long
+__alloc_page_array(gfp_t gfp_mask, unsigned long nr_pages,
+		   struct page **page_array,
+		   struct zonelist *zonelist, nodemask_t *nodemask)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	struct zone *preferred_zone;
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	unsigned long nr = 0;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfp_mask);
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (unlikely(!zonelist->_zonerefs->zone))
+		return 0;
+
+	first_zones_zonelist(zonelist, high_zoneidx, nodemask, &preferred_zone);
+	if (!preferred_zone)
+		return 0;
+
+	if (!cpuset_zone_allowed_softwall(preferred_zone,
+					  gfp_mask | __GFP_HARDWALL) ||
+	    should_fail_alloc_page(gfp_mask, 0))
+		goto slowpath;
+
+	while (nr < nr_pages) {
+		unsigned long batch, got;
+
+		batch = min(nr_pages - nr, (unsigned long)PAGE_ARRAY_BATCH);
+		if (!zone_watermark_ok(preferred_zone, 0,
+				low_wmark_pages(preferred_zone) + batch,
+				zone_idx(preferred_zone), 0))
+			break;
+
+		got = rmqueue_pcp_array(preferred_zone, preferred_zone,
+					gfp_mask, migratetype, batch,
+					page_array + nr);
+		nr += got;
+		if (got < batch)
+			break;
+	}
+
+slowpath:
+	while (nr < nr_pages) {
+		struct page *page;
+
+		page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+		if (unlikely(!page))
+			break;
+		page_array[nr++] = page;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(__alloc_page_array);
+
 /*
  * Common helper functions.
  */
@@ -1961,6 +2230,78 @@ void __free_pages(struct page *page, unsigned int order)
 
 EXPORT_SYMBOL(__free_pages);
 
+/*
+ * Hand a list of prepared order-0 pages to the per-cpu lists of their
+ * zones with interrupts disabled once.
+ */
+static void free_pcp_list(struct list_head *list)
+{
+	struct page *page, *next;
+	unsigned long flags;
+	int cpu = get_cpu();
+
+	local_irq_save(flags);
+	list_for_each_entry_safe(page, next, list, lru) {
+		struct zone *zone = page_zone(page);
+		struct per_cpu_pages *pcp = &zone_pcp(zone, cpu)->pcp;
+
+		set_page_private(page, get_pageblock_migratetype(page));
+		__count_vm_event(PGFREE);
+		list_move(&page->lru, &pcp->list);
+		pcp->count++;
+		if (pcp->count >= pcp->high) {
+			free_pages_bulk(zone, pcp->batch, &pcp->list, 0);
+			pcp->count -= pcp->batch;
+		}
+	}
+	local_irq_restore(flags);
+	put_cpu();
+}
+
+/**
+ * __free_page_array - free an array of order-0 pages
+ * @pages: the pages
+ * @nr_pages: number of entries in @pages
+ *
+ * Drops a reference on each page, like __free_page(), and returns the
+ * pages that became free to the per-cpu lists in batches with interrupts
+ * disabled once per batch.  @pages itself is not modified.
+ */
+void __free_page_array(struct page **pages, unsigned long nr_pages)
+{
+	LIST_HEAD(list);
+	unsigned long i;
+	int batch = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+		int wasMlocked;
+
+		if (!put_page_testzero(page))
+			continue;
+
+		wasMlocked = TestClearPageMlocked(page);
+		if (free_pcp_prepare(page))
+			continue;
+		if (unlikely(wasMlocked)) {
+			unsigned long flags;
+
+			local_irq_save(flags);
+			free_page_mlock(page);
+			local_irq_restore(flags);
+		}
+
+		list_add(&page->lru, &list);
+		if (++batch == PAGE_ARRAY_BATCH) {
+			free_pcp_list(&list);
+			batch = 0;
+		}
+	}
+	if (batch)
+		free_pcp_list(&list);
+}
+EXPORT_SYMBOL(__free_page_array);
+
 void free_pages(unsigned long addr, unsigned int order)
 {
 	if (addr != 0) {
@@ -0,0 +1,145 @@
+/*
+ * page allocator benchmark
+ *
+ * Compares order-0 allocation and freeing one page at a time through
+ * alloc_page()/__free_page() with the batched alloc_page_array()/
+ * __free_page_array() interface, and reports pages per second for each.
+ */
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+/* run time and sleep time in seconds */
+#define RUN_TIME	5
+#define SLEEP_TIME	10
+
+#define MAX_BATCH	1024
+
+static int batch = 64;
+module_param(batch, int, 0444);
+MODULE_PARM_DESC(batch, "pages allocated and freed per round (1-1024)");
+
+static int rounds;
+module_param(rounds, int, 0444);
+MODULE_PARM_DESC(rounds, "number of benchmark runs, 0 to run until unloaded");
+
+static struct task_struct *bench_task;
+static struct page **pages;
+
+/* allocate and free one batch a page at a time; returns pages handled */
+static unsigned long bench_single(void)
+{
+	unsigned long nr, i;
+
+	for (nr = 0; nr < batch; nr++) {
+		pages[nr] = alloc_page(GFP_KERNEL);
+		if (!pages[nr])
+			break;
+	}
+	for (i = 0; i < nr; i++)
+		__free_page(pages[i]);
+
+	return nr;
+}
+
+/* the same through the array interface */
+static unsigned long bench_array(void)
+{
+	unsigned long nr;
+
+	nr = alloc_page_array(GFP_KERNEL, batch, pages);
+	__free_page_array(pages, nr);
+
+	return nr;
+}
+
+static void bench_run(const char *name, unsigned long (*fn)(void))
+{
+	unsigned long long total = 0;
+	ktime_t start, end;
+	s64 usecs;
+
+	start = ktime_get();
+	do {
+		unsigned long nr = fn();
+
+		if (!nr) {
+			printk(KERN_WARNING "page_alloc_benchmark: %s: "
+			       "out of memory\n", name);
+			return;
+		}
+		total += nr;
+		cond_resched();
+		end = ktime_get();
+	} while (ktime_us_delta(end, start) < RUN_TIME * USEC_PER_SEC &&
+		 !kthread_should_stop());
+
+	usecs = ktime_us_delta(end, start);
+	if (!usecs)
+		usecs = 1;
+
+	printk(KERN_INFO "page_alloc_benchmark: %-6s batch %d: %llu pages "
+	       "in %lld us, %llu pages/sec\n", name, batch, total,
+	       (long long)usecs, div64_u64(total * USEC_PER_SEC, usecs));
+}
+
+static int page_alloc_benchmark_thread(void *arg)
+{
+	int run = 0;
+
+	while (!kthread_should_stop()) {
+		if (!rounds || run < rounds) {
+			bench_run("single", bench_single);
+			bench_run("array", bench_array);
+			run++;
+		}
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (rounds && run >= rounds)
+			schedule();
+		else
+			schedule_timeout(HZ * SLEEP_TIME);
+		__set_current_state(TASK_RUNNING);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int __init page_alloc_benchmark_init(void)
+{
+	if (batch < 1 || batch > MAX_BATCH)
+		return -EINVAL;
+
+	pages = kmalloc(batch * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	bench_task = kthread_run(page_alloc_benchmark_thread, NULL,
+				 "page_alloc_bench");
+	if (IS_ERR(bench_task)) {
+		kfree(pages);
+		return PTR_ERR(bench_task);
+	}
+
+	return 0;
+}
+
+static void __exit page_alloc_benchmark_exit(void)
+{
+	kthread_stop(bench_task);
+	kfree(pages);
+}
+
+module_init(page_alloc_benchmark_init);
+module_exit(page_alloc_benchmark_exit);
+
+MODULE_DESCRIPTION("page_alloc_benchmark");
+MODULE_LICENSE("GPL");
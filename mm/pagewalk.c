@@ -1,6 +1,7 @@
 #include <linux/mm.h>
 #include <linux/highmem.h>
 #include <linux/sched.h>
+#include <linux/hugetlb.h>
 
 static int walk_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 			  struct mm_walk *walk)
@@ -33,7 +34,18 @@ static int walk_pmd_range(pud_t *pud, unsigned long addr, unsigned long end,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd)) {
+		/*
+		 * The callbacks only know how to walk pte tables, but a
+		 * hugetlbfs pmd also looks trans_huge and must not be split:
+		 * leave it for the check below to report as a hole.
+		 */
+		if (pmd_trans_huge(*pmd)) {
+			struct vm_area_struct *vma = find_vma(walk->mm, addr);
+
+			if (!vma || !is_vm_hugetlb_page(vma))
+				split_huge_page_pmd(walk->mm, pmd);
+		}
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd)) {
 			if (walk->pte_hole)
 				err = walk->pte_hole(addr, next, walk);
 			if (err)
@@ -191,14 +191,14 @@ void __init anon_vma_init(void)
  * Getting a lock on a stable anon_vma from a page off the LRU is
  * tricky: page_lock_anon_vma rely on RCU to guard against the races.
  */
-static struct anon_vma *page_lock_anon_vma(struct page *page)
+struct anon_vma *page_lock_anon_vma(struct page *page)
 {
 	struct anon_vma *anon_vma;
 	unsigned long anon_mapping;
 
 	rcu_read_lock();
 	anon_mapping = (unsigned long) page->mapping;
-	if (!(anon_mapping & PAGE_MAPPING_ANON))
+	if ((anon_mapping & PAGE_MAPPING_FLAGS) != PAGE_MAPPING_ANON)
 		goto out;
 	if (!page_mapped(page))
 		goto out;
@@ -211,7 +211,7 @@ out:
 	return NULL;
 }
 
-static void page_unlock_anon_vma(struct anon_vma *anon_vma)
+void page_unlock_anon_vma(struct anon_vma *anon_vma)
 {
 	spin_unlock(&anon_vma->lock);
 	rcu_read_unlock();
@@ -222,8 +222,7 @@ static void page_unlock_anon_vma(struct anon_vma *anon_vma)
  * Returns virtual address or -EFAULT if page's index/offset is not
  * within the range mapped the @vma.
  */
-static inline unsigned long
-vma_address(struct page *page, struct vm_area_struct *vma)
+unsigned long vma_address(struct page *page, struct vm_area_struct *vma)
 {
 	pgoff_t pgoff = page->index << (PAGE_CACHE_SHIFT - PAGE_SHIFT);
 	unsigned long address;
@@ -284,6 +283,13 @@ pte_t *page_check_address(struct page *page, struct mm_struct *mm,
 	pmd = pmd_offset(pud, address);
 	if (!pmd_present(*pmd))
 		return NULL;
+	/*
+	 * Huge pmds map no ptes.  This also keeps hugetlbfs pmds out of
+	 * pte_offset_map(), though hugetlb pages are not on the LRU and
+	 * never get here.
+	 */
+	if (pmd_trans_huge(*pmd))
+		return NULL;
 
 	pte = pte_offset_map(pmd, address);
 	/* Make a quick check before getting the lock */
@@ -339,17 +345,30 @@ static int page_referenced_one(struct page *page,
 {
 	struct mm_struct *mm = vma->vm_mm;
 	unsigned long address;
-	pte_t *pte;
+	pmd_t *pmd = NULL;
+	pte_t *pte = NULL;
 	spinlock_t *ptl;
 	int referenced = 0;
+	int young;
 
 	address = vma_address(page, vma);
 	if (address == -EFAULT)
 		goto out;
 
-	pte = page_check_address(page, mm, address, &ptl, 0);
-	if (!pte)
-		goto out;
+	if (unlikely(PageTransHuge(page))) {
+		ptl = &mm->page_table_lock;
+		spin_lock(ptl);
+		pmd = page_check_address_pmd(page, mm, address,
+					     PAGE_CHECK_ADDRESS_PMD_FLAG);
+		if (!pmd) {
+			spin_unlock(ptl);
+			goto out;
+		}
+	} else {
+		pte = page_check_address(page, mm, address, &ptl, 0);
+		if (!pte)
+			goto out;
+	}
 
 	/*
 	 * Don't want to elevate referenced for mlocked page that gets this far,
@@ -361,7 +380,12 @@ static int page_referenced_one(struct page *page,
 		goto out_unmap;
 	}
 
-	if (ptep_clear_flush_young_notify(vma, address, pte)) {
+	/* a splitting pmd still maps the whole page: go ahead */
+	if (pte)
+		young = ptep_clear_flush_young_notify(vma, address, pte);
+	else
+		young = pmdp_clear_flush_young_notify(vma, address, pmd);
+	if (young) {
 		/*
 		 * Don't treat a reference through a sequentially read
 		 * mapping as such.  If the page has been used in
@@ -381,7 +405,10 @@ static int page_referenced_one(struct page *page,
 
 out_unmap:
 	(*mapcount)--;
-	pte_unmap_unlock(pte, ptl);
+	if (pte)
+		pte_unmap_unlock(pte, ptl);
+	else
+		spin_unlock(ptl);
 out:
 	if (referenced)
 		*vm_flags |= vma->vm_flags;
@@ -621,7 +648,10 @@ static void __page_set_anon_rmap(struct page *page,
 	 * nr_mapped state can be updated without turning off
 	 * interrupts because it is not modified via interrupt.
 	 */
-	__inc_zone_page_state(page, NR_ANON_PAGES);
+	if (PageTransHuge(page))
+		__inc_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	else
+		__inc_zone_page_state(page, NR_ANON_PAGES);
 }
 
 /**
@@ -751,10 +781,15 @@ void page_remove_rmap(struct page *page)
 			page_clear_dirty(page);
 			set_page_dirty(page);
 		}
-		if (PageAnon(page))
+		if (PageAnon(page)) {
 			mem_cgroup_uncharge_page(page);
-		__dec_zone_page_state(page,
-			PageAnon(page) ? NR_ANON_PAGES : NR_FILE_MAPPED);
+			if (PageTransHuge(page))
+				__dec_zone_page_state(page,
+					NR_ANON_TRANSPARENT_HUGEPAGES);
+			else
+				__dec_zone_page_state(page, NR_ANON_PAGES);
+		} else
+			__dec_zone_page_state(page, NR_FILE_MAPPED);
 		mem_cgroup_update_mapped_file_stat(page, -1);
 		/*
 		 * It would be tidy to reset the PageAnon mapping here,
@@ -55,6 +55,11 @@ static void __page_cache_release(struct page *page)
 		del_page_from_lru(zone, page);
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
 	}
+}
+
+static void __put_single_page(struct page *page)
+{
+	__page_cache_release(page);
 	free_hot_page(page);
 }
 
@@ -64,6 +69,8 @@ static void put_compound_page(struct page *page)
 	if (put_page_testzero(page)) {
 		compound_page_dtor *dtor;
 
+		/* transparent huge pages live on the LRU */
+		__page_cache_release(page);
 		dtor = get_compound_page_dtor(page);
 		(*dtor)(page);
 	}
@@ -74,7 +81,7 @@ void put_page(struct page *page)
 	if (unlikely(PageCompound(page)))
 		put_compound_page(page);
 	else if (put_page_testzero(page))
-		__page_cache_release(page);
+		__put_single_page(page);
 }
 EXPORT_SYMBOL(put_page);
 
@@ -264,6 +271,40 @@ void add_page_to_unevictable_list(struct page *page)
 	spin_unlock_irq(&zone->lru_lock);
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Used by split_huge_page() to put a tail page of the huge page being
+ * split onto the LRU list of its head page.  The caller holds
+ * zone->lru_lock.
+ */
+void lru_add_page_tail(struct zone *zone,
+		       struct page *page, struct page *page_tail)
+{
+	enum lru_list lru;
+
+	VM_BUG_ON(!PageHead(page));
+	VM_BUG_ON(PageCompound(page_tail));
+	VM_BUG_ON(PageLRU(page_tail));
+	VM_BUG_ON(!spin_is_locked(&zone->lru_lock));
+
+	SetPageLRU(page_tail);
+
+	if (page_evictable(page_tail, NULL)) {
+		if (PageActive(page)) {
+			SetPageActive(page_tail);
+			lru = LRU_ACTIVE_ANON;
+		} else
+			lru = LRU_INACTIVE_ANON;
+		update_page_reclaim_stat(zone, page_tail, 0,
+					 !!PageActive(page));
+	} else {
+		SetPageUnevictable(page_tail);
+		lru = LRU_UNEVICTABLE;
+	}
+	add_page_to_lru_list(zone, page_tail, lru);
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * Drain pages out of the cpu's pagevecs.
  * Either "cpu" is the current CPU, and preemption has already been
@@ -141,6 +141,16 @@ int add_to_swap(struct page *page)
 		if (!entry.val)
 			return 0;
 
+		/*
+		 * Swap space is allocated and written one small page at a
+		 * time: split a huge page only once we know there is room.
+		 */
+		if (unlikely(PageTransHuge(page)) &&
+		    unlikely(split_huge_page(page))) {
+			swapcache_free(entry, NULL);
+			return 0;
+		}
+
 		/*
 		 * Radix-tree node allocations from PF_MEMALLOC contexts could
 		 * completely exhaust the page allocator. __GFP_NOMEMALLOC
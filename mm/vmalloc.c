@@ -1295,14 +1295,7 @@ static void __vunmap(const void *addr, int deallocate_pages)
 	debug_check_no_obj_freed(addr, area->size);
 
 	if (deallocate_pages) {
-		int i;
-
-		for (i = 0; i < area->nr_pages; i++) {
-			struct page *page = area->pages[i];
-
-			BUG_ON(!page);
-			__free_page(page);
-		}
+		__free_page_array(area->pages, area->nr_pages);
 
 		if (area->flags & VM_VPAGES)
 			vfree(area->pages);
@@ -1415,20 +1408,15 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 		return NULL;
 	}
 
-	for (i = 0; i < area->nr_pages; i++) {
-		struct page *page;
-
-		if (node < 0)
-			page = alloc_page(gfp_mask);
-		else
-			page = alloc_pages_node(node, gfp_mask, 0);
-
-		if (unlikely(!page)) {
-			/* Successfully allocated i pages, free them in __vunmap() */
-			area->nr_pages = i;
-			goto fail;
-		}
-		area->pages[i] = page;
+	if (node < 0)
+		i = alloc_page_array(gfp_mask, area->nr_pages, area->pages);
+	else
+		i = alloc_page_array_node(node, gfp_mask, area->nr_pages,
+					  area->pages);
+	if (unlikely(i < area->nr_pages)) {
+		/* Successfully allocated i pages, free them in __vunmap() */
+		area->nr_pages = i;
+		goto fail;
 	}
 
 	if (map_vm_area(area, prot, &pages))
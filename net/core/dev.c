@@ -1736,7 +1736,7 @@ gso:
 			return rc;
 		}
 		txq_trans_update(txq);
-		if (unlikely(netif_tx_queue_stopped(txq) && skb->next))
+		if (unlikely(netif_xmit_stopped(txq) && skb->next))
 			return NETDEV_TX_BUSY;
 	} while (skb->next);
 
@@ -1786,6 +1786,35 @@ static struct netdev_queue *dev_pick_tx(struct net_device *dev,
 	return netdev_get_tx_queue(dev, queue_index);
 }
 
+static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q)
+{
+	spinlock_t *root_lock = qdisc_lock(q);
+	int rc;
+
+	/* Lockless qdiscs are enqueued to and run without the root lock. */
+	if (q->flags & TCQ_F_NOLOCK) {
+		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+			kfree_skb(skb);
+			return NET_XMIT_DROP;
+		}
+		rc = qdisc_enqueue_root(skb, q);
+		qdisc_run(q);
+		return rc;
+	}
+
+	spin_lock(root_lock);
+	if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+		kfree_skb(skb);
+		rc = NET_XMIT_DROP;
+	} else {
+		rc = qdisc_enqueue_root(skb, q);
+		qdisc_run(q);
+	}
+	spin_unlock(root_lock);
+
+	return rc;
+}
+
 /**
  *	dev_queue_xmit - transmit a buffer
  *	@skb: buffer to transmit
@@ -1859,19 +1888,7 @@ gso:
 	skb->tc_verd = SET_TC_AT(skb->tc_verd,AT_EGRESS);
 #endif
 	if (q->enqueue) {
-		spinlock_t *root_lock = qdisc_lock(q);
-
-		spin_lock(root_lock);
-
-		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
-			kfree_skb(skb);
-			rc = NET_XMIT_DROP;
-		} else {
-			rc = qdisc_enqueue_root(skb, q);
-			qdisc_run(q);
-		}
-		spin_unlock(root_lock);
-
+		rc = __dev_xmit_skb(skb, q);
 		goto out;
 	}
 
@@ -1952,38 +1969,168 @@ DEFINE_PER_CPU(struct netif_rx_stats, netdev_rx_stat) = { 0, };
  *
  */
 
-int netif_rx(struct sk_buff *skb)
+#ifdef CONFIG_RPS
+static u32 rps_hashrnd __read_mostly;
+
+/*
+ * get_rps_cpu is called from netif_rx and netif_receive_skb, under
+ * rcu_read_lock.  It hashes the flow (addresses and, for unfragmented
+ * packets, ports) and returns the CPU from the device's map that the
+ * packet should be processed on, or -1 to process it locally.
+ */
+static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb)
+{
+	struct rps_map *map;
+	struct ipv6hdr *ip6;
+	struct iphdr *ip;
+	u32 addr1, addr2, ports, hash;
+	u8 ip_proto;
+	int ihl, tcpu;
+
+	map = rcu_dereference(dev->rps_map);
+	if (!map)
+		return -1;
+
+	if (map->len == 1) {
+		tcpu = map->cpus[0];
+		goto found;
+	}
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		if (!pskb_may_pull(skb, sizeof(*ip)))
+			return -1;
+
+		ip = (struct iphdr *) skb->data;
+		ip_proto = ip->protocol;
+		if (ip->frag_off & htons(IP_MF | IP_OFFSET))
+			ip_proto = 0;
+		addr1 = (__force u32) ip->saddr;
+		addr2 = (__force u32) ip->daddr;
+		ihl = ip->ihl;
+		break;
+	case __constant_htons(ETH_P_IPV6):
+		if (!pskb_may_pull(skb, sizeof(*ip6)))
+			return -1;
+
+		ip6 = (struct ipv6hdr *) skb->data;
+		ip_proto = ip6->nexthdr;
+		addr1 = (__force u32) ip6->saddr.s6_addr32[3];
+		addr2 = (__force u32) ip6->daddr.s6_addr32[3];
+		ihl = (40 >> 2);
+		break;
+	default:
+		return -1;
+	}
+
+	ports = 0;
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_DCCP:
+	case IPPROTO_ESP:
+	case IPPROTO_AH:
+	case IPPROTO_SCTP:
+	case IPPROTO_UDPLITE:
+		if (pskb_may_pull(skb, (ihl * 4) + 4))
+			ports = *((u32 *) (skb->data + (ihl * 4)));
+		break;
+	default:
+		break;
+	}
+
+	hash = jhash_3words(addr1, addr2, ports, rps_hashrnd);
+	tcpu = map->cpus[((u64) hash * map->len) >> 32];
+found:
+	return cpu_online(tcpu) ? tcpu : -1;
+}
+
+/* Called from hardirq (IPI) context */
+static void rps_trigger_softirq(void *data)
+{
+	struct softnet_data *queue = data;
+
+	__napi_schedule(&queue->backlog);
+	__get_cpu_var(netdev_rx_stat).received_rps++;
+}
+
+/*
+ * Queue the remote CPU's backlog to be kicked by an IPI once this CPU's
+ * NET_RX softirq has run, so several packets for it cost one IPI.
+ * Must be called with interrupts disabled.
+ */
+static int rps_ipi_queued(struct softnet_data *queue)
+{
+	struct softnet_data *mysd = &__get_cpu_var(softnet_data);
+
+	if (queue == mysd)
+		return 0;
+
+	queue->rps_ipi_next = mysd->rps_ipi_list;
+	mysd->rps_ipi_list = queue;
+	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+	return 1;
+}
+#endif /* CONFIG_RPS */
+
+/*
+ * With RPS, other CPUs enqueue to our backlog, so the input queue is
+ * protected by its lock (in addition to disabling interrupts).
+ */
+static inline void rps_lock(struct softnet_data *queue)
+{
+#ifdef CONFIG_RPS
+	spin_lock(&queue->input_pkt_queue.lock);
+#endif
+}
+
+static inline void rps_unlock(struct softnet_data *queue)
+{
+#ifdef CONFIG_RPS
+	spin_unlock(&queue->input_pkt_queue.lock);
+#endif
+}
+
+/*
+ * enqueue_to_backlog is called to queue an skb to a per CPU backlog
+ * queue (may be a remote CPU queue).
+ */
+static int enqueue_to_backlog(struct sk_buff *skb, int cpu)
 {
 	struct softnet_data *queue;
 	unsigned long flags;
 
-	/* if netpoll wants it, pretend we never saw it */
-	if (netpoll_rx(skb))
-		return NET_RX_DROP;
-
-	if (!skb->tstamp.tv64)
-		net_timestamp(skb);
+	queue = &per_cpu(softnet_data, cpu);
 
 	/*
 	 * The code is rearranged so that the path is the most
 	 * short when CPU is congested, but is still operating.
 	 */
 	local_irq_save(flags);
-	queue = &__get_cpu_var(softnet_data);
-
 	__get_cpu_var(netdev_rx_stat).total++;
+
+	rps_lock(queue);
 	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
 		if (queue->input_pkt_queue.qlen) {
 enqueue:
 			__skb_queue_tail(&queue->input_pkt_queue, skb);
+			rps_unlock(queue);
 			local_irq_restore(flags);
 			return NET_RX_SUCCESS;
 		}
 
-		napi_schedule(&queue->backlog);
+		/* Schedule NAPI for the backlog device */
+		if (napi_schedule_prep(&queue->backlog)) {
+#ifdef CONFIG_RPS
+			if (!rps_ipi_queued(queue))
+#endif
+				__napi_schedule(&queue->backlog);
+		}
 		goto enqueue;
 	}
 
+	rps_unlock(queue);
+
 	__get_cpu_var(netdev_rx_stat).dropped++;
 	local_irq_restore(flags);
 
@@ -1991,6 +2138,38 @@ enqueue:
 	return NET_RX_DROP;
 }
 
+int netif_rx(struct sk_buff *skb)
+{
+	int ret;
+
+	/* if netpoll wants it, pretend we never saw it */
+	if (netpoll_rx(skb))
+		return NET_RX_DROP;
+
+	if (!skb->tstamp.tv64)
+		net_timestamp(skb);
+
+#ifdef CONFIG_RPS
+	{
+		int cpu;
+
+		rcu_read_lock();
+		cpu = get_rps_cpu(skb->dev, skb);
+		if (cpu < 0)
+			cpu = get_cpu();
+		else
+			get_cpu();
+		ret = enqueue_to_backlog(skb, cpu);
+		put_cpu();
+		rcu_read_unlock();
+	}
+#else
+	ret = enqueue_to_backlog(skb, get_cpu());
+	put_cpu();
+#endif
+	return ret;
+}
+
 int netif_rx_ni(struct sk_buff *skb)
 {
 	int err;
@@ -2041,6 +2220,13 @@ static void net_tx_action(struct softirq_action *h)
 
 			head = head->next_sched;
 
+			if (q->flags & TCQ_F_NOLOCK) {
+				smp_mb__before_clear_bit();
+				clear_bit(__QDISC_STATE_SCHED, &q->state);
+				qdisc_run(q);
+				continue;
+			}
+
 			root_lock = qdisc_lock(q);
 			if (spin_trylock(root_lock)) {
 				smp_mb__before_clear_bit();
@@ -2225,22 +2411,7 @@ void netif_nit_deliver(struct sk_buff *skb)
 	rcu_read_unlock();
 }
 
-/**
- *	netif_receive_skb - process receive buffer from network
- *	@skb: buffer to process
- *
- *	netif_receive_skb() is the main receive data processing function.
- *	It always succeeds. The buffer may be dropped during processing
- *	for congestion control or by the protocol layers.
- *
- *	This function may only be called from softirq context and interrupts
- *	should be enabled.
- *
- *	Return values (usually ignored):
- *	NET_RX_SUCCESS: no congestion
- *	NET_RX_DROP: packet was dropped
- */
-int netif_receive_skb(struct sk_buff *skb)
+static int __netif_receive_skb(struct sk_buff *skb)
 {
 	struct packet_type *ptype, *pt_prev;
 	struct net_device *orig_dev;
@@ -2337,6 +2508,42 @@ out:
 	return ret;
 }
 
+/**
+ *	netif_receive_skb - process receive buffer from network
+ *	@skb: buffer to process
+ *
+ *	netif_receive_skb() is the main receive data processing function.
+ *	It always succeeds. The buffer may be dropped during processing
+ *	for congestion control or by the protocol layers.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled.
+ *
+ *	Return values (usually ignored):
+ *	NET_RX_SUCCESS: no congestion
+ *	NET_RX_DROP: packet was dropped
+ */
+int netif_receive_skb(struct sk_buff *skb)
+{
+#ifdef CONFIG_RPS
+	int cpu, ret;
+
+	rcu_read_lock();
+	cpu = get_rps_cpu(skb->dev, skb);
+	if (cpu >= 0) {
+		if (!skb->tstamp.tv64)
+			net_timestamp(skb);
+		ret = enqueue_to_backlog(skb, cpu);
+	} else
+		ret = __netif_receive_skb(skb);
+	rcu_read_unlock();
+
+	return ret;
+#else
+	return __netif_receive_skb(skb);
+#endif
+}
+
 /* Network device is going away, flush any packets still pending  */
 static void flush_backlog(void *arg)
 {
@@ -2344,11 +2551,13 @@ static void flush_backlog(void *arg)
 	struct softnet_data *queue = &__get_cpu_var(softnet_data);
 	struct sk_buff *skb, *tmp;
 
+	rps_lock(queue);
 	skb_queue_walk_safe(&queue->input_pkt_queue, skb, tmp)
 		if (skb->dev == dev) {
 			__skb_unlink(skb, &queue->input_pkt_queue);
 			kfree_skb(skb);
 		}
+	rps_unlock(queue);
 }
 
 static int napi_gro_complete(struct sk_buff *skb)
@@ -2668,15 +2877,18 @@ static int process_backlog(struct napi_struct *napi, int quota)
 		struct sk_buff *skb;
 
 		local_irq_disable();
+		rps_lock(queue);
 		skb = __skb_dequeue(&queue->input_pkt_queue);
 		if (!skb) {
 			__napi_complete(napi);
+			rps_unlock(queue);
 			local_irq_enable();
 			break;
 		}
+		rps_unlock(queue);
 		local_irq_enable();
 
-		netif_receive_skb(skb);
+		__netif_receive_skb(skb);
 	} while (++work < quota && jiffies == start_time);
 
 	return work;
@@ -2766,9 +2978,38 @@ void netif_napi_del(struct napi_struct *napi)
 EXPORT_SYMBOL(netif_napi_del);
 
 
+/*
+ * net_rps_action sends any pending IPI's for RPS.
+ * Note: called with local irq disabled, but exits with local irq enabled.
+ */
+static void net_rps_action_and_irq_enable(struct softnet_data *sd)
+{
+#ifdef CONFIG_RPS
+	struct softnet_data *remsd = sd->rps_ipi_list;
+
+	if (remsd) {
+		sd->rps_ipi_list = NULL;
+
+		local_irq_enable();
+
+		/* Send pending IPI's to kick RPS processing on remote cpus. */
+		while (remsd) {
+			struct softnet_data *next = remsd->rps_ipi_next;
+
+			if (cpu_online(remsd->cpu))
+				__smp_call_function_single(remsd->cpu,
+							   &remsd->csd, 0);
+			remsd = next;
+		}
+	} else
+#endif
+		local_irq_enable();
+}
+
 static void net_rx_action(struct softirq_action *h)
 {
-	struct list_head *list = &__get_cpu_var(softnet_data).poll_list;
+	struct softnet_data *sd = &__get_cpu_var(softnet_data);
+	struct list_head *list = &sd->poll_list;
 	unsigned long time_limit = jiffies + 2;
 	int budget = netdev_budget;
 	void *have;
@@ -2834,7 +3075,7 @@ static void net_rx_action(struct softirq_action *h)
 		netpoll_poll_unlock(have);
 	}
 out:
-	local_irq_enable();
+	net_rps_action_and_irq_enable(sd);
 
 #ifdef CONFIG_NET_DMA
 	/*
@@ -3077,10 +3318,10 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct netif_rx_stats *s = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
 		   s->total, s->dropped, s->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   s->cpu_collision );
+		   s->cpu_collision, s->received_rps);
 	return 0;
 }
 
@@ -5044,6 +5285,9 @@ static void netdev_init_one_queue(struct net_device *dev,
 				  void *_unused)
 {
 	queue->dev = dev;
+#ifdef CONFIG_BQL
+	dql_init(&queue->dql, HZ);
+#endif
 }
 
 static void netdev_init_queues(struct net_device *dev)
@@ -5380,6 +5624,16 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	raise_softirq_irqoff(NET_TX_SOFTIRQ);
 	local_irq_enable();
 
+	/*
+	 * The offline CPU's backlog may have been scheduled by a remote
+	 * CPU (RPS) without ever running; take it off its poll list so it
+	 * can be scheduled again if the CPU comes back.
+	 */
+	if (test_bit(NAPI_STATE_SCHED, &oldsd->backlog.state)) {
+		list_del_init(&oldsd->backlog.poll_list);
+		clear_bit(NAPI_STATE_SCHED, &oldsd->backlog.state);
+	}
+
 	/* Process offline CPU's input_pkt_queue */
 	while ((skb = __skb_dequeue(&oldsd->input_pkt_queue)))
 		netif_rx(skb);
@@ -5584,6 +5838,14 @@ static int __init net_dev_init(void)
 		queue->completion_queue = NULL;
 		INIT_LIST_HEAD(&queue->poll_list);
 
+#ifdef CONFIG_RPS
+		queue->csd.func = rps_trigger_softirq;
+		queue->csd.info = queue;
+		queue->csd.flags = 0;
+		queue->cpu = i;
+#endif
+
+		INIT_LIST_HEAD(&queue->backlog.poll_list);
 		queue->backlog.poll = process_backlog;
 		queue->backlog.weight = weight_p;
 		queue->backlog.gro_list = NULL;
@@ -5623,6 +5885,9 @@ subsys_initcall(net_dev_init);
 static int __init initialize_hashrnd(void)
 {
 	get_random_bytes(&skb_tx_hashrnd, sizeof(skb_tx_hashrnd));
+#ifdef CONFIG_RPS
+	get_random_bytes(&rps_hashrnd, sizeof(rps_hashrnd));
+#endif
 	return 0;
 }
 
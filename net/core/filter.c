@@ -64,6 +64,102 @@ static inline void *load_pointer(struct sk_buff *skb, int k,
 	}
 }
 
+/*
+ * Load ancillary data for a load from offset k in [SKF_AD_OFF, 0).
+ * Returns 0 if the filter must return 0, otherwise stores the value in *A.
+ */
+static int load_ancillary(struct sk_buff *skb, int k, u32 *A, u32 X)
+{
+	switch (k-SKF_AD_OFF) {
+	case SKF_AD_PROTOCOL:
+		*A = ntohs(skb->protocol);
+		return 1;
+	case SKF_AD_PKTTYPE:
+		*A = skb->pkt_type;
+		return 1;
+	case SKF_AD_IFINDEX:
+		*A = skb->dev->ifindex;
+		return 1;
+	case SKF_AD_NLATTR: {
+		struct nlattr *nla;
+
+		if (skb_is_nonlinear(skb))
+			return 0;
+		if (*A > skb->len - sizeof(struct nlattr))
+			return 0;
+
+		nla = nla_find((struct nlattr *)&skb->data[*A],
+			       skb->len - *A, X);
+		if (nla)
+			*A = (void *)nla - (void *)skb->data;
+		else
+			*A = 0;
+		return 1;
+	}
+	case SKF_AD_NLATTR_NEST: {
+		struct nlattr *nla;
+
+		if (skb_is_nonlinear(skb))
+			return 0;
+		if (*A > skb->len - sizeof(struct nlattr))
+			return 0;
+
+		nla = (struct nlattr *)&skb->data[*A];
+		if (nla->nla_len > *A - skb->len)
+			return 0;
+
+		nla = nla_find_nested(nla, X);
+		if (nla)
+			*A = (void *)nla - (void *)skb->data;
+		else
+			*A = 0;
+		return 1;
+	}
+	default:
+		return 0;
+	}
+}
+
+#ifdef CONFIG_BPF_JIT
+/**
+ *	bpf_jit_load - slow path of packet loads for JIT compiled filters
+ *	@skb: buffer the filter runs on
+ *	@k: offset of the load
+ *	@size: 4, 2 or 1 bytes
+ *	@A: accumulator, updated with the loaded value
+ *	@X: index register
+ *	@ancillary: 0 for BPF_LDX|BPF_B|BPF_MSH, which ignores ancillary data
+ *
+ * Compiled filters only load directly from the linear part of the skb,
+ * everything else comes here so it gets exactly the interpreter's
+ * semantics.  Returns 0 if the filter must return 0.
+ */
+int bpf_jit_load(struct sk_buff *skb, int k, unsigned int size, u32 *A,
+		 u32 X, int ancillary)
+{
+	u32 tmp;
+	void *ptr;
+
+	ptr = load_pointer(skb, k, size, &tmp);
+	if (ptr != NULL) {
+		switch (size) {
+		case 4:
+			*A = get_unaligned_be32(ptr);
+			break;
+		case 2:
+			*A = get_unaligned_be16(ptr);
+			break;
+		default:
+			*A = *(u8 *)ptr;
+			break;
+		}
+		return 1;
+	}
+
+	return ancillary ? load_ancillary(skb, k, A, X) : 0;
+}
+#endif
+
 /**
  *	sk_filter - run a packet through a socket filter
  *	@sk: sock associated with &sk_buff
@@ -88,8 +184,8 @@ int sk_filter(struct sock *sk, struct sk_buff *skb)
 	rcu_read_lock_bh();
 	filter = rcu_dereference(sk->sk_filter);
 	if (filter) {
-		unsigned int pkt_len = sk_run_filter(skb, filter->insns,
-				filter->len);
+		unsigned int pkt_len = SK_RUN_FILTER(filter, skb);
+
 		err = pkt_len ? pskb_trim(skb, pkt_len) : -EPERM;
 	}
 	rcu_read_unlock_bh();
@@ -293,54 +389,8 @@ load_b:
 		 * Handle ancillary data, which are impossible
 		 * (or very difficult) to get parsing packet contents.
 		 */
-		switch (k-SKF_AD_OFF) {
-		case SKF_AD_PROTOCOL:
-			A = ntohs(skb->protocol);
-			continue;
-		case SKF_AD_PKTTYPE:
-			A = skb->pkt_type;
-			continue;
-		case SKF_AD_IFINDEX:
-			A = skb->dev->ifindex;
-			continue;
-		case SKF_AD_NLATTR: {
-			struct nlattr *nla;
-
-			if (skb_is_nonlinear(skb))
-				return 0;
-			if (A > skb->len - sizeof(struct nlattr))
-				return 0;
-
-			nla = nla_find((struct nlattr *)&skb->data[A],
-				       skb->len - A, X);
-			if (nla)
-				A = (void *)nla - (void *)skb->data;
-			else
-				A = 0;
-			continue;
-		}
-		case SKF_AD_NLATTR_NEST: {
-			struct nlattr *nla;
-
-			if (skb_is_nonlinear(skb))
-				return 0;
-			if (A > skb->len - sizeof(struct nlattr))
-				return 0;
-
-			nla = (struct nlattr *)&skb->data[A];
-			if (nla->nla_len > A - skb->len)
-				return 0;
-
-			nla = nla_find_nested(nla, X);
-			if (nla)
-				A = (void *)nla - (void *)skb->data;
-			else
-				A = 0;
-			continue;
-		}
-		default:
+		if (!load_ancillary(skb, k, &A, X))
 			return 0;
-		}
 	}
 
 	return 0;
@@ -507,6 +557,7 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 
 	atomic_set(&fp->refcnt, 1);
 	fp->len = fprog->len;
+	fp->bpf_func = NULL;
 
 	err = sk_chk_filter(fp->insns, fp->len);
 	if (err) {
@@ -514,6 +565,8 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 		return err;
 	}
 
+	bpf_jit_compile(fp);
+
 	rcu_read_lock_bh();
 	old_fp = rcu_dereference(sk->sk_filter);
 	rcu_assign_pointer(sk->sk_filter, fp);
@@ -247,6 +247,161 @@ static ssize_t show_ifalias(struct device *dev,
 	return ret;
 }
 
+#ifdef CONFIG_RPS
+static ssize_t show_rps_cpus(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *map;
+	cpumask_var_t mask;
+	size_t len;
+	int i;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	rcu_read_lock();
+	map = rcu_dereference(net->rps_map);
+	if (map)
+		for (i = 0; i < map->len; i++)
+			cpumask_set_cpu(map->cpus[i], mask);
+	rcu_read_unlock();
+
+	len = cpumask_scnprintf(buf, PAGE_SIZE - 2, mask);
+	len += sprintf(buf + len, "\n");
+
+	free_cpumask_var(mask);
+	return len;
+}
+
+static void rps_map_release(struct rcu_head *rcu)
+{
+	struct rps_map *map = container_of(rcu, struct rps_map, rcu);
+
+	kfree(map);
+}
+
+static DEFINE_SPINLOCK(rps_map_lock);
+
+static ssize_t store_rps_cpus(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t len)
+{
+	struct net_device *net = to_net_dev(dev);
+	struct rps_map *old_map, *map;
+	cpumask_var_t mask;
+	int err, cpu, i;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	err = bitmap_parse(buf, len, cpumask_bits(mask), nr_cpumask_bits);
+	if (err) {
+		free_cpumask_var(mask);
+		return err;
+	}
+
+	map = kzalloc(max_t(unsigned,
+			    RPS_MAP_SIZE(cpumask_weight(mask)), L1_CACHE_BYTES),
+		      GFP_KERNEL);
+	if (!map) {
+		free_cpumask_var(mask);
+		return -ENOMEM;
+	}
+
+	i = 0;
+	for_each_cpu_and(cpu, mask, cpu_online_mask)
+		map->cpus[i++] = cpu;
+
+	if (i)
+		map->len = i;
+	else {
+		kfree(map);
+		map = NULL;
+	}
+
+	spin_lock(&rps_map_lock);
+	old_map = net->rps_map;
+	rcu_assign_pointer(net->rps_map, map);
+	spin_unlock(&rps_map_lock);
+
+	if (old_map)
+		call_rcu(&old_map->rcu, rps_map_release);
+
+	free_cpumask_var(mask);
+	return len;
+}
+#endif /* CONFIG_RPS */
+
+#ifdef CONFIG_BQL
+/*
+ * Bounds for the byte queue limits of the transmit queues.  Writes apply
+ * to every tx queue, reads report the first one.
+ */
+static ssize_t format_bql_limit_max(const struct net_device *net, char *buf)
+{
+	return sprintf(buf, "%u\n", netdev_get_tx_queue(net, 0)->dql.max_limit);
+}
+
+static ssize_t show_bql_limit_max(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	return netdev_show(dev, attr, buf, format_bql_limit_max);
+}
+
+static int change_bql_limit_max(struct net_device *net, unsigned long limit)
+{
+	unsigned int i;
+
+	if (limit > DQL_MAX_LIMIT)
+		return -EINVAL;
+
+	for (i = 0; i < net->num_tx_queues; i++)
+		netdev_get_tx_queue(net, i)->dql.max_limit = limit;
+	return 0;
+}
+
+static ssize_t store_bql_limit_max(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t len)
+{
+	return netdev_store(dev, attr, buf, len, change_bql_limit_max);
+}
+
+static ssize_t format_bql_limit_min(const struct net_device *net, char *buf)
+{
+	return sprintf(buf, "%u\n", netdev_get_tx_queue(net, 0)->dql.min_limit);
+}
+
+static ssize_t show_bql_limit_min(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	return netdev_show(dev, attr, buf, format_bql_limit_min);
+}
+
+static int change_bql_limit_min(struct net_device *net, unsigned long limit)
+{
+	unsigned int i;
+
+	if (limit > DQL_MAX_LIMIT)
+		return -EINVAL;
+
+	for (i = 0; i < net->num_tx_queues; i++)
+		netdev_get_tx_queue(net, i)->dql.min_limit = limit;
+	return 0;
+}
+
+static ssize_t store_bql_limit_min(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t len)
+{
+	return netdev_store(dev, attr, buf, len, change_bql_limit_min);
+}
+#endif /* CONFIG_BQL */
+
 static struct device_attribute net_class_attributes[] = {
 	__ATTR(addr_len, S_IRUGO, show_addr_len, NULL),
 	__ATTR(dev_id, S_IRUGO, show_dev_id, NULL),
@@ -265,6 +420,15 @@ static struct device_attribute net_class_attributes[] = {
 	__ATTR(flags, S_IRUGO | S_IWUSR, show_flags, store_flags),
 	__ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len,
 	       store_tx_queue_len),
+#ifdef CONFIG_RPS
+	__ATTR(rps_cpus, S_IRUGO | S_IWUSR, show_rps_cpus, store_rps_cpus),
+#endif
+#ifdef CONFIG_BQL
+	__ATTR(bql_limit_max, S_IRUGO | S_IWUSR, show_bql_limit_max,
+	       store_bql_limit_max),
+	__ATTR(bql_limit_min, S_IRUGO | S_IWUSR, show_bql_limit_min,
+	       store_bql_limit_min),
+#endif
 	{}
 };
 
@@ -460,6 +624,9 @@ static void netdev_release(struct device *d)
 	BUG_ON(dev->reg_state != NETREG_RELEASED);
 
 	kfree(dev->ifalias);
+#ifdef CONFIG_RPS
+	kfree(dev->rps_map);
+#endif
 	kfree((char *)dev - dev->padded);
 }
 
@@ -16,6 +16,10 @@
 #include <linux/netdevice.h>
 #include <linux/module.h>
 #include <linux/icmp.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/hash.h>
+#include <linux/bitmap.h>
 #include <net/ip.h>
 #include <net/compat.h>
 #include <asm/uaccess.h>
@@ -25,6 +29,7 @@
 #include <linux/cpumask.h>
 
 #include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_tcpudp.h>
 #include <linux/netfilter_ipv4/ip_tables.h>
 #include <net/netfilter/nf_log.h>
 
@@ -303,6 +308,290 @@ struct ipt_entry *ipt_next_entry(const struct ipt_entry *entry)
 	return (void *)entry + entry->next_offset;
 }
 
+#ifdef CONFIG_IP_NF_IPTABLES_CLASSIFY
+/*
+ * Rule classification index.
+ *
+ * With large rule sets most of the time in ipt_do_table() goes into
+ * stepping over rules which cannot match the packet.  When a table is
+ * loaded we therefore sort packets into classes by protocol and, for TCP
+ * and UDP, a hash of the destination port, and record for each class the
+ * offsets of the rules which could match a packet of that class, in table
+ * order.  ipt_do_table() then steps from candidate to candidate.
+ *
+ * A rule is left out of a class only if ip_packet_match() or the rule's
+ * first match is certain to fail, without side effects, for all packets
+ * of that class; skipping it is thus invisible.  Fragments and packets
+ * with a truncated TCP/UDP header are not classified and walk every rule.
+ */
+#define IPT_CLS_PORT_BITS	6
+#define IPT_CLS_PORTS		(1 << IPT_CLS_PORT_BITS)
+#define IPT_CLS_TCP		0
+#define IPT_CLS_UDP		(IPT_CLS_TCP + IPT_CLS_PORTS)
+#define IPT_CLS_ICMP		(IPT_CLS_UDP + IPT_CLS_PORTS)
+#define IPT_CLS_OTHER		(IPT_CLS_ICMP + 1)
+#define IPT_CLS_NUM		(IPT_CLS_OTHER + 1)
+
+/* Smaller tables are walked faster than looked up */
+#define IPT_CLS_MIN_RULES	32
+
+struct ipt_classifier {
+	/* Class c has the candidates offsets[start[c]] .. [start[c+1] - 1] */
+	unsigned int start[IPT_CLS_NUM + 1];
+	unsigned int offsets[0];
+};
+
+static inline unsigned int ipt_cls_port(unsigned int port)
+{
+	return hash_32(port, IPT_CLS_PORT_BITS);
+}
+
+/* Performance critical - called for every packet */
+static inline int
+ipt_classify(const struct sk_buff *skb, const struct xt_match_param *par)
+{
+	const struct iphdr *ip = ip_hdr(skb);
+
+	switch (ip->protocol) {
+	case IPPROTO_TCP: {
+		const struct tcphdr *th;
+		struct tcphdr _tcph;
+
+		if (par->fragoff != 0)
+			return -1;
+		th = skb_header_pointer(skb, par->thoff, sizeof(_tcph), &_tcph);
+		if (th == NULL)
+			return -1;
+		return IPT_CLS_TCP + ipt_cls_port(ntohs(th->dest));
+	}
+	case IPPROTO_UDP: {
+		const struct udphdr *uh;
+		struct udphdr _udph;
+
+		if (par->fragoff != 0)
+			return -1;
+		uh = skb_header_pointer(skb, par->thoff, sizeof(_udph), &_udph);
+		if (uh == NULL)
+			return -1;
+		return IPT_CLS_UDP + ipt_cls_port(ntohs(uh->dest));
+	}
+	case IPPROTO_ICMP:
+		return IPT_CLS_ICMP;
+	default:
+		return IPT_CLS_OTHER;
+	}
+}
+
+/* Returns the first candidate of the class at or after offset */
+static inline const unsigned int *
+ipt_cls_seek(const struct ipt_classifier *cls, int class, unsigned int offset)
+{
+	const unsigned int *lo = cls->offsets + cls->start[class];
+	const unsigned int *hi = cls->offsets + cls->start[class + 1] - 1;
+
+	/* The last entry of the table is a candidate for every class */
+	while (lo < hi) {
+		const unsigned int *mid = lo + (hi - lo) / 2;
+
+		if (*mid < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* (Re)classifies the packet and moves *e to its first candidate */
+static inline const unsigned int *
+ipt_cls_start(const struct ipt_classifier *cls, const struct sk_buff *skb,
+	      const struct xt_match_param *par, int *class,
+	      void *table_base, struct ipt_entry **e)
+{
+	const unsigned int *cand;
+
+	if (cls == NULL)
+		return NULL;
+	*class = ipt_classify(skb, par);
+	if (*class < 0)
+		return NULL;
+	cand = ipt_cls_seek(cls, *class, (void *)*e - table_base);
+	*e = get_entry(table_base, *cand);
+	return cand;
+}
+
+/* Continues at e, or at the first candidate after it */
+static inline struct ipt_entry *
+ipt_cls_goto(const struct ipt_classifier *cls, int class,
+	     const unsigned int **cand, void *table_base, struct ipt_entry *e)
+{
+	if (*cand == NULL)
+		return e;
+	*cand = ipt_cls_seek(cls, class, (void *)e - table_base);
+	return get_entry(table_base, **cand);
+}
+
+/* Performance critical: the rule e did not match */
+static inline struct ipt_entry *
+ipt_cls_next(const unsigned int **cand, void *table_base, struct ipt_entry *e)
+{
+	if (*cand == NULL)
+		return ipt_next_entry(e);
+	return get_entry(table_base, *++*cand);
+}
+
+/* Finds the packet classes that entry e could match */
+static void
+ipt_entry_classes(const struct ipt_entry *e, bool last, unsigned long *classes)
+{
+	const struct ipt_entry_match *m = (void *)e->elems;
+	const __u16 *dpts = NULL;
+	unsigned int base, port;
+
+	bitmap_zero(classes, IPT_CLS_NUM);
+
+	if (last || e->ip.proto == 0 || (e->ip.invflags & IPT_INV_PROTO)) {
+		bitmap_fill(classes, IPT_CLS_NUM);
+		return;
+	}
+
+	switch (e->ip.proto) {
+	case IPPROTO_TCP:
+		base = IPT_CLS_TCP;
+		break;
+	case IPPROTO_UDP:
+		base = IPT_CLS_UDP;
+		break;
+	case IPPROTO_ICMP:
+		__set_bit(IPT_CLS_ICMP, classes);
+		return;
+	default:
+		__set_bit(IPT_CLS_OTHER, classes);
+		return;
+	}
+
+	/*
+	 * Later matches only run if the earlier ones match, which may have
+	 * side effects (limit, recent, ...), so only the first one counts.
+	 */
+	if (e->target_offset > sizeof(struct ipt_entry)) {
+		const char *name = m->u.kernel.match->name;
+
+		if (base == IPT_CLS_TCP && strcmp(name, "tcp") == 0) {
+			const struct xt_tcp *tcpinfo = (void *)m->data;
+
+			if (!(tcpinfo->invflags & XT_TCP_INV_DSTPT))
+				dpts = tcpinfo->dpts;
+		} else if (base == IPT_CLS_UDP && strcmp(name, "udp") == 0) {
+			const struct xt_udp *udpinfo = (void *)m->data;
+
+			if (!(udpinfo->invflags & XT_UDP_INV_DSTPT))
+				dpts = udpinfo->dpts;
+		}
+	}
+
+	if (dpts != NULL && dpts[1] - dpts[0] < IPT_CLS_PORTS) {
+		/* An empty range (dpts[0] > dpts[1]) never matches */
+		for (port = dpts[0]; port <= dpts[1]; port++)
+			__set_bit(base + ipt_cls_port(port), classes);
+	} else {
+		for (port = 0; port < IPT_CLS_PORTS; port++)
+			__set_bit(base + port, classes);
+	}
+}
+
+/*
+ * Builds the classification index of a checked table.  Failure is not
+ * fatal, the table is then just walked rule by rule.
+ */
+static void
+ipt_build_classifier(struct xt_table_info *info, void *entry0)
+{
+	DECLARE_BITMAP(classes, IPT_CLS_NUM);
+	struct ipt_classifier *cls;
+	struct ipt_entry *e;
+	unsigned int off, total, size;
+	int c;
+
+	if (info->number < IPT_CLS_MIN_RULES)
+		return;
+
+	total = 0;
+	for (off = 0; off < info->size; off += e->next_offset) {
+		e = entry0 + off;
+		ipt_entry_classes(e, off + e->next_offset >= info->size,
+				  classes);
+		total += bitmap_weight(classes, IPT_CLS_NUM);
+	}
+
+	size = sizeof(*cls) + total * sizeof(cls->offsets[0]);
+	if (size <= PAGE_SIZE)
+		cls = kzalloc(size, GFP_KERNEL);
+	else
+		cls = vmalloc(size);
+	if (cls == NULL)
+		return;
+
+	/* Count the candidates of each class, and turn that into starts */
+	memset(cls->start, 0, sizeof(cls->start));
+	for (off = 0; off < info->size; off += e->next_offset) {
+		e = entry0 + off;
+		ipt_entry_classes(e, off + e->next_offset >= info->size,
+				  classes);
+		for (c = 0; c < IPT_CLS_NUM; c++)
+			if (test_bit(c, classes))
+				cls->start[c + 1]++;
+	}
+	for (c = 0; c < IPT_CLS_NUM; c++)
+		cls->start[c + 1] += cls->start[c];
+
+	/* Fill in the offsets, using start[c] as the cursor of class c */
+	for (off = 0; off < info->size; off += e->next_offset) {
+		e = entry0 + off;
+		ipt_entry_classes(e, off + e->next_offset >= info->size,
+				  classes);
+		for (c = 0; c < IPT_CLS_NUM; c++)
+			if (test_bit(c, classes))
+				cls->offsets[cls->start[c]++] = off;
+	}
+	/* ... which leaves start[c] at the start of class c + 1 */
+	memmove(&cls->start[1], &cls->start[0],
+		IPT_CLS_NUM * sizeof(cls->start[0]));
+	cls->start[0] = 0;
+
+	duprintf("ipt_build_classifier: %u rules, %u candidates\n",
+		 info->number, total);
+	info->classifier = cls;
+}
+#else
+struct ipt_classifier;
+
+static inline const unsigned int *
+ipt_cls_start(const struct ipt_classifier *cls, const struct sk_buff *skb,
+	      const struct xt_match_param *par, int *class,
+	      void *table_base, struct ipt_entry **e)
+{
+	return NULL;
+}
+
+static inline struct ipt_entry *
+ipt_cls_goto(const struct ipt_classifier *cls, int class,
+	     const unsigned int **cand, void *table_base, struct ipt_entry *e)
+{
+	return e;
+}
+
+static inline struct ipt_entry *
+ipt_cls_next(const unsigned int **cand, void *table_base, struct ipt_entry *e)
+{
+	return ipt_next_entry(e);
+}
+
+static inline void
+ipt_build_classifier(struct xt_table_info *info, void *entry0)
+{
+}
+#endif /* CONFIG_IP_NF_IPTABLES_CLASSIFY */
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff *skb,
@@ -325,6 +614,9 @@ ipt_do_table(struct sk_buff *skb,
 	struct xt_table_info *private;
 	struct xt_match_param mtpar;
 	struct xt_target_param tgpar;
+	const struct ipt_classifier *cls;
+	const unsigned int *cand;
+	int class = -1;
 
 	/* Initialization */
 	ip = ip_hdr(skb);
@@ -351,6 +643,8 @@ ipt_do_table(struct sk_buff *skb,
 	table_base = private->entries[smp_processor_id()];
 
 	e = get_entry(table_base, private->hook_entry[hook]);
+	cls = private->classifier;
+	cand = ipt_cls_start(cls, skb, &mtpar, &class, table_base, &e);
 
 	/* For return from builtin chain */
 	back = get_entry(table_base, private->underflow[hook]);
@@ -363,7 +657,7 @@ ipt_do_table(struct sk_buff *skb,
 		if (!ip_packet_match(ip, indev, outdev,
 		    &e->ip, mtpar.fragoff) ||
 		    IPT_MATCH_ITERATE(e, do_match, skb, &mtpar) != 0) {
-			e = ipt_next_entry(e);
+			e = ipt_cls_next(&cand, table_base, e);
 			continue;
 		}
 
@@ -390,7 +684,8 @@ ipt_do_table(struct sk_buff *skb,
 					verdict = (unsigned)(-v) - 1;
 					break;
 				}
-				e = back;
+				e = ipt_cls_goto(cls, class, &cand,
+						 table_base, back);
 				back = get_entry(table_base, back->comefrom);
 				continue;
 			}
@@ -403,7 +698,8 @@ ipt_do_table(struct sk_buff *skb,
 				back = next;
 			}
 
-			e = get_entry(table_base, v);
+			e = ipt_cls_goto(cls, class, &cand, table_base,
+					 get_entry(table_base, v));
 			continue;
 		}
 
@@ -429,9 +725,12 @@ ipt_do_table(struct sk_buff *skb,
 		ip = ip_hdr(skb);
 		datalen = skb->len - ip->ihl * 4;
 
-		if (verdict == IPT_CONTINUE)
+		if (verdict == IPT_CONTINUE) {
 			e = ipt_next_entry(e);
-		else
+			/* The target may have changed the class */
+			cand = ipt_cls_start(cls, skb, &mtpar, &class,
+					     table_base, &e);
+		} else
 			/* Verdict */
 			break;
 	} while (!hotdrop);
@@ -860,6 +1159,7 @@ translate_table(const char *name,
 			memcpy(newinfo->entries[i], entry0, newinfo->size);
 	}
 
+	ipt_build_classifier(newinfo, entry0);
 	return ret;
 }
 
@@ -1774,6 +2074,7 @@ translate_compat_table(const char *name,
 		if (newinfo->entries[i] && newinfo->entries[i] != entry1)
 			memcpy(newinfo->entries[i], entry1, newinfo->size);
 
+	ipt_build_classifier(newinfo, entry1);
 	*pinfo = newinfo;
 	*pentry0 = entry1;
 	xt_free_table_info(info);
@@ -2057,7 +2358,7 @@ struct xt_table *ipt_register_table(struct net *net, struct xt_table *table,
 	int ret;
 	struct xt_table_info *newinfo;
 	struct xt_table_info bootstrap
-		= { 0, 0, 0, { 0 }, { 0 }, { } };
+		= { 0, 0, 0, { 0 }, { 0 }, NULL, { } };
 	void *loc_cpu_entry;
 	struct xt_table *new_table;
 
@@ -0,0 +1,280 @@
+/*
+ * ip_tables rule count benchmark
+ *
+ * Loads tables of increasing size into a private table that is not
+ * attached to any hook, and times ipt_do_table() for a TCP and a UDP
+ * packet that match none of the rules, so that every packet is checked
+ * against the whole chain before hitting the ACCEPT policy.  Rules are
+ * "-p tcp --dport N -j DROP" and "-p udp --dport N -j DROP" in turn;
+ * with the wildcard parameter, that percentage of them is "-d ADDR
+ * -j DROP" instead, which the classification index cannot sort by
+ * protocol or port.
+ *
+ * All the work is done from module init, which then fails with -EAGAIN
+ * so that the module can be loaded again right away.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/skbuff.h>
+#include <linux/vmalloc.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/netfilter/xt_tcpudp.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <net/net_namespace.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ip_tables rule count benchmark");
+
+#define BENCH_VALID_HOOKS	(1 << NF_INET_LOCAL_OUT)
+#define BENCH_MAX_COUNTS	16
+
+static unsigned int rules[BENCH_MAX_COUNTS] = {
+	16, 64, 256, 1024, 4096, 8192,
+};
+static int nr_counts = 6;
+module_param_array(rules, uint, &nr_counts, 0444);
+MODULE_PARM_DESC(rules, "rule counts to sweep (up to 16 values)");
+
+static unsigned int iterations = 10000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "packets run through each table per protocol");
+
+static unsigned int wildcard;
+module_param(wildcard, uint, 0444);
+MODULE_PARM_DESC(wildcard, "percentage of rules matching any protocol (0-100)");
+
+static struct xt_table bench_table = {
+	.name		= "ipt_bench",
+	.valid_hooks	= BENCH_VALID_HOOKS,
+	.me		= THIS_MODULE,
+	.af		= AF_INET,
+};
+
+static const struct ipt_standard bench_policy = IPT_STANDARD_INIT(NF_ACCEPT);
+static const struct ipt_error bench_term = IPT_ERROR_INIT;
+
+/* Both matches take the same space; see bench_add_rule() */
+#define BENCH_MATCH_SIZE \
+	XT_ALIGN(sizeof(struct xt_entry_match) + sizeof(struct xt_tcp))
+#define BENCH_RULE_SIZE \
+	(sizeof(struct ipt_entry) + BENCH_MATCH_SIZE + \
+	 IPT_ALIGN(sizeof(struct ipt_standard_target)))
+
+/* Ports and addresses of the rules; the probe packets use neither. */
+#define BENCH_PORT_BASE		1024
+#define BENCH_ADDR_BASE		0xc0a80000	/* 192.168.0.0 */
+#define BENCH_SADDR		0x0a000002	/* 10.0.0.2 */
+#define BENCH_DADDR		0x0a000001	/* 10.0.0.1 */
+#define BENCH_TCP_DPORT		80
+#define BENCH_UDP_DPORT		53
+
+/* Writes rule @i at @e and returns its size */
+static unsigned int bench_add_rule(struct ipt_entry *e, unsigned int i)
+{
+	struct ipt_standard_target *t;
+	unsigned int size;
+
+	memset(e, 0, BENCH_RULE_SIZE);
+	size = sizeof(*e);
+
+	if (i % 100 < wildcard) {
+		e->ip.dst.s_addr = htonl(BENCH_ADDR_BASE + i);
+		e->ip.dmsk.s_addr = htonl(0xffffffff);
+	} else {
+		struct xt_entry_match *m = (void *)e + size;
+		u16 port = BENCH_PORT_BASE + i % (65536 - BENCH_PORT_BASE);
+
+		m->u.user.match_size = BENCH_MATCH_SIZE;
+		if (i & 1) {
+			struct xt_udp *udp = (void *)m->data;
+
+			e->ip.proto = IPPROTO_UDP;
+			strcpy(m->u.user.name, "udp");
+			udp->spts[1] = 0xffff;
+			udp->dpts[0] = udp->dpts[1] = port;
+		} else {
+			struct xt_tcp *tcp = (void *)m->data;
+
+			e->ip.proto = IPPROTO_TCP;
+			strcpy(m->u.user.name, "tcp");
+			tcp->spts[1] = 0xffff;
+			tcp->dpts[0] = tcp->dpts[1] = port;
+		}
+		size += BENCH_MATCH_SIZE;
+	}
+
+	e->target_offset = size;
+	t = (void *)e + size;
+	t->target.u.user.target_size = sizeof(struct ipt_standard_target);
+	strcpy(t->target.u.user.name, IPT_STANDARD_TARGET);
+	t->verdict = -NF_DROP - 1;
+	size += IPT_ALIGN(sizeof(struct ipt_standard_target));
+	e->next_offset = size;
+
+	return size;
+}
+
+static struct ipt_replace *bench_build_table(unsigned int n)
+{
+	struct ipt_replace *repl;
+	unsigned int size = 0, i;
+
+	repl = vmalloc(sizeof(*repl) + n * BENCH_RULE_SIZE +
+		       sizeof(bench_policy) + sizeof(bench_term));
+	if (!repl)
+		return NULL;
+
+	memset(repl, 0, sizeof(*repl));
+	strcpy(repl->name, bench_table.name);
+	repl->valid_hooks = BENCH_VALID_HOOKS;
+	repl->num_entries = n + 2;
+
+	for (i = 0; i < n; i++)
+		size += bench_add_rule((void *)repl->entries + size, i);
+
+	repl->hook_entry[NF_INET_LOCAL_OUT] = 0;
+	repl->underflow[NF_INET_LOCAL_OUT] = size;
+	memcpy((void *)repl->entries + size, &bench_policy,
+	       sizeof(bench_policy));
+	size += sizeof(bench_policy);
+	memcpy((void *)repl->entries + size, &bench_term, sizeof(bench_term));
+	size += sizeof(bench_term);
+	repl->size = size;
+
+	return repl;
+}
+
+static struct sk_buff *bench_alloc_skb(u8 proto, u16 dport)
+{
+	struct sk_buff *skb;
+	struct iphdr *iph;
+	unsigned int thlen;
+
+	thlen = proto == IPPROTO_TCP ? sizeof(struct tcphdr) :
+				       sizeof(struct udphdr);
+	skb = alloc_skb(sizeof(*iph) + thlen, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	skb_reset_network_header(skb);
+	iph = (struct iphdr *)skb_put(skb, sizeof(*iph));
+	memset(iph, 0, sizeof(*iph));
+	iph->version = 4;
+	iph->ihl = sizeof(*iph) / 4;
+	iph->tot_len = htons(sizeof(*iph) + thlen);
+	iph->ttl = 64;
+	iph->protocol = proto;
+	iph->saddr = htonl(BENCH_SADDR);
+	iph->daddr = htonl(BENCH_DADDR);
+
+	skb_set_transport_header(skb, sizeof(*iph));
+	if (proto == IPPROTO_TCP) {
+		struct tcphdr *th = (struct tcphdr *)skb_put(skb, thlen);
+
+		memset(th, 0, thlen);
+		th->source = htons(40000);
+		th->dest = htons(dport);
+		th->doff = thlen / 4;
+		th->syn = 1;
+	} else {
+		struct udphdr *uh = (struct udphdr *)skb_put(skb, thlen);
+
+		memset(uh, 0, thlen);
+		uh->source = htons(40000);
+		uh->dest = htons(dport);
+		uh->len = htons(thlen);
+	}
+	return skb;
+}
+
+/* Stores the average ns per packet in @ns; fails if a rule matched */
+static int bench_run(struct xt_table *table, struct sk_buff *skb, u64 *ns)
+{
+	ktime_t start;
+	unsigned int i;
+
+	if (ipt_do_table(skb, NF_INET_LOCAL_OUT, NULL, NULL, table) !=
+	    NF_ACCEPT)
+		return -EINVAL;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		ipt_do_table(skb, NF_INET_LOCAL_OUT, NULL, NULL, table);
+		if (!(i % 256))
+			cond_resched();
+	}
+	*ns = div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), iterations);
+
+	return 0;
+}
+
+static int bench_one(unsigned int n, struct sk_buff *tcp, struct sk_buff *udp)
+{
+	struct ipt_replace *repl;
+	struct xt_table *table;
+	u64 tcp_ns, udp_ns;
+	int err;
+
+	repl = bench_build_table(n);
+	if (!repl)
+		return -ENOMEM;
+	table = ipt_register_table(&init_net, &bench_table, repl);
+	vfree(repl);
+	if (IS_ERR(table))
+		return PTR_ERR(table);
+
+	err = bench_run(table, tcp, &tcp_ns);
+	if (!err)
+		err = bench_run(table, udp, &udp_ns);
+	ipt_unregister_table(table);
+
+	if (err) {
+		printk(KERN_ERR "ipt_benchmark: %u rules: probe packet "
+		       "was not accepted\n", n);
+		return err;
+	}
+
+	printk(KERN_INFO "ipt_benchmark: %5u rules, %u%% wildcard: "
+	       "tcp %llu ns/packet, udp %llu ns/packet\n", n, wildcard,
+	       (unsigned long long)tcp_ns, (unsigned long long)udp_ns);
+	return 0;
+}
+
+static int __init ipt_benchmark_init(void)
+{
+	struct sk_buff *tcp, *udp;
+	int i, err = 0;
+
+	if (!iterations || wildcard > 100)
+		return -EINVAL;
+
+	tcp = bench_alloc_skb(IPPROTO_TCP, BENCH_TCP_DPORT);
+	udp = bench_alloc_skb(IPPROTO_UDP, BENCH_UDP_DPORT);
+	if (!tcp || !udp) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr_counts && !err; i++)
+		err = bench_one(rules[i], tcp, udp);
+
+	/* Nothing to keep loaded: fail so it can be run again */
+	if (!err)
+		err = -EAGAIN;
+out:
+	kfree_skb(tcp);
+	kfree_skb(udp);
+	return err;
+}
+
+module_init(ipt_benchmark_init);
@@ -2089,7 +2089,7 @@ struct xt_table *ip6t_register_table(struct net *net, struct xt_table *table,
 	int ret;
 	struct xt_table_info *newinfo;
 	struct xt_table_info bootstrap
-		= { 0, 0, 0, { 0 }, { 0 }, { } };
+		= { 0, 0, 0, { 0 }, { 0 }, NULL, { } };
 	void *loc_cpu_entry;
 	struct xt_table *new_table;
 
@@ -655,6 +655,10 @@ void xt_free_table_info(struct xt_table_info *info)
 		else
 			vfree(info->entries[cpu]);
 	}
+	if (is_vmalloc_addr(info->classifier))
+		vfree(info->classifier);
+	else
+		kfree(info->classifier);
 	kfree(info);
 }
 EXPORT_SYMBOL(xt_free_table_info);
@@ -158,9 +158,38 @@ struct packet_mreq_max
 };
 
 #ifdef CONFIG_PACKET_MMAP
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		int closing, int tx_ring);
 
+/*
+ * TPACKET_V3 block queue.  Packets are packed back to back into the
+ * current block; a block is handed to user space when it is full or
+ * when the retire timer expires.
+ */
+struct tpacket_kbdq_core {
+	char			**pkbdq;
+	unsigned int		hdrlen;
+	unsigned char		reset_pending_on_curr_blk;
+	unsigned char		delete_blk_timer;
+	unsigned short		version;
+	unsigned int		kactive_blk_num;
+	unsigned int		last_kactive_blk_num;
+	unsigned int		blk_sizeof_priv;
+	char			*pkblk_start;
+	char			*pkblk_end;
+	unsigned int		kblk_size;
+	unsigned int		max_frame_len;
+	unsigned int		knum_blocks;
+	u64			knxt_seq_num;
+	char			*prev;
+	char			*nxt_offset;
+	/* packets being copied into the current block */
+	atomic_t		blk_fill_in_prog;
+	unsigned int		retire_blk_tov;
+	unsigned long		tov_in_jiffies;
+	struct timer_list	retire_blk_timer;
+};
+
 struct packet_ring_buffer {
 	char *			*pg_vec;
 	unsigned int		head;
@@ -172,9 +201,35 @@ struct packet_ring_buffer {
 	unsigned int		pg_vec_pages;
 	unsigned int		pg_vec_len;
 
+	struct tpacket_kbdq_core	prb_bdqc;
 	atomic_t		pending;
 };
 
+#define V3_ALIGNMENT		8
+#define BLK_HDR_LEN		ALIGN(sizeof(struct tpacket_block_desc), V3_ALIGNMENT)
+#define BLK_PLUS_PRIV(sz_of_priv) \
+	(BLK_HDR_LEN + ALIGN((sz_of_priv), V3_ALIGNMENT))
+#define TOTAL_PKT_LEN_INCL_ALIGN(length) ALIGN((length), V3_ALIGNMENT)
+
+/* Default block retire timeout, in msecs */
+#define DEFAULT_PRB_RETIRE_TOV	8
+
+#define BLOCK_STATUS(x)		((x)->hdr.bh1.block_status)
+#define BLOCK_NUM_PKTS(x)	((x)->hdr.bh1.num_pkts)
+#define BLOCK_O2FP(x)		((x)->hdr.bh1.offset_to_first_pkt)
+#define BLOCK_LEN(x)		((x)->hdr.bh1.blk_len)
+#define BLOCK_SNUM(x)		((x)->hdr.bh1.seq_num)
+#define BLOCK_O2PRIV(x)		((x)->offset_to_priv)
+
+#define GET_PBDQC_FROM_RB(x)	(&(x)->prb_bdqc)
+#define GET_PBLOCK_DESC(x, bid)	\
+	((struct tpacket_block_desc *)((x)->pkbdq[(bid)]))
+#define GET_CURR_PBLOCK_DESC_FROM_CORE(x) \
+	GET_PBLOCK_DESC(x, (x)->kactive_blk_num)
+#define GET_NEXT_PRB_BLK_NUM(x) \
+	(((x)->kactive_blk_num < ((x)->knum_blocks - 1)) ? \
+	 ((x)->kactive_blk_num + 1) : 0)
+
 struct packet_sock;
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg);
 #endif
@@ -189,6 +244,7 @@ struct packet_sock {
 	struct packet_ring_buffer	rx_ring;
 	struct packet_ring_buffer	tx_ring;
 	int			copy_thresh;
+	unsigned int		tp_freeze_q_cnt;
 #endif
 	struct packet_type	prot_hook;
 	spinlock_t		bind_lock;
@@ -314,6 +370,330 @@ static inline void packet_increment_head(struct packet_ring_buffer *buff)
 	buff->head = buff->head != buff->frame_max ? buff->head+1 : 0;
 }
 
+/*
+ * TPACKET_V3 block queue, protected by sk_receive_queue.lock.
+ *
+ * The kernel owns the current block (kactive_blk_num) and fills it from
+ * tpacket_rcv().  When a packet does not fit, or when the retire timer
+ * expires, the block is closed: its status is set to TP_STATUS_USER and
+ * the next block is opened.  If user space still holds the next block,
+ * the queue is frozen and packets are dropped until that block is
+ * handed back (status reset to TP_STATUS_KERNEL).
+ */
+static void prb_retire_rx_blk_timer_expired(unsigned long data);
+
+static unsigned int prb_block_status(struct tpacket_block_desc *pbd)
+{
+	smp_rmb();
+	flush_dcache_page(virt_to_page(pbd));
+	return BLOCK_STATUS(pbd);
+}
+
+static void prb_shutdown_retire_blk_timer(struct packet_sock *po,
+		struct sk_buff_head *rb_queue)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+
+	spin_lock_bh(&rb_queue->lock);
+	pkc->delete_blk_timer = 1;
+	spin_unlock_bh(&rb_queue->lock);
+
+	del_timer_sync(&pkc->retire_blk_timer);
+}
+
+static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *pkc)
+{
+	mod_timer(&pkc->retire_blk_timer, jiffies + pkc->tov_in_jiffies);
+	pkc->last_kactive_blk_num = pkc->kactive_blk_num;
+}
+
+static void prb_open_block(struct tpacket_kbdq_core *pkc,
+		struct tpacket_block_desc *pbd)
+{
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+	struct timespec ts;
+
+	BLOCK_SNUM(pbd) = pkc->knxt_seq_num++;
+	BLOCK_NUM_PKTS(pbd) = 0;
+	BLOCK_LEN(pbd) = BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	getnstimeofday(&ts);
+	h1->ts_first_pkt.ts_sec = ts.tv_sec;
+	h1->ts_first_pkt.ts_nsec = ts.tv_nsec;
+
+	pkc->pkblk_start = (char *)pbd;
+	pkc->nxt_offset = pkc->pkblk_start +
+			  BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	BLOCK_O2FP(pbd) = BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	BLOCK_O2PRIV(pbd) = BLK_HDR_LEN;
+	pbd->version = pkc->version;
+	pkc->prev = pkc->nxt_offset;
+	pkc->pkblk_end = pkc->pkblk_start + pkc->kblk_size;
+
+	/* Opening a block thaws the queue */
+	pkc->reset_pending_on_curr_blk = 0;
+
+	_prb_refresh_rx_retire_blk_timer(pkc);
+	smp_wmb();
+}
+
+static void init_prb_bdqc(struct packet_sock *po,
+		struct packet_ring_buffer *rb, char **pg_vec,
+		union tpacket_req_u *req_u)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(rb);
+
+	memset(pkc, 0, sizeof(*pkc));
+
+	pkc->knxt_seq_num = 1;
+	pkc->pkbdq = pg_vec;
+	pkc->kblk_size = req_u->req3.tp_block_size;
+	pkc->knum_blocks = req_u->req3.tp_block_nr;
+	pkc->hdrlen = po->tp_hdrlen;
+	pkc->version = po->tp_version;
+	po->tp_freeze_q_cnt = 0;
+
+	if (req_u->req3.tp_retire_blk_tov)
+		pkc->retire_blk_tov = req_u->req3.tp_retire_blk_tov;
+	else
+		pkc->retire_blk_tov = DEFAULT_PRB_RETIRE_TOV;
+	pkc->tov_in_jiffies = msecs_to_jiffies(pkc->retire_blk_tov);
+	if (!pkc->tov_in_jiffies)
+		pkc->tov_in_jiffies = 1;
+
+	pkc->blk_sizeof_priv = req_u->req3.tp_sizeof_priv;
+	/* Leave room for the alignment of the last packet */
+	pkc->max_frame_len = pkc->kblk_size -
+			     BLK_PLUS_PRIV(pkc->blk_sizeof_priv) - V3_ALIGNMENT;
+
+	setup_timer(&pkc->retire_blk_timer, prb_retire_rx_blk_timer_expired,
+		    (unsigned long)po);
+	prb_open_block(pkc, GET_PBLOCK_DESC(pkc, 0));
+}
+
+/* Hand the block to user space, flushing it out for non-coherent caches */
+static void prb_flush_block(struct tpacket_kbdq_core *pkc,
+		struct tpacket_block_desc *pbd, __u32 status)
+{
+	char *start = (char *)pbd;
+	char *end = pkc->pkblk_end;
+
+	for (start += PAGE_SIZE; start < end; start += PAGE_SIZE)
+		flush_dcache_page(virt_to_page(start));
+
+	smp_wmb();
+
+	BLOCK_STATUS(pbd) = status;
+	flush_dcache_page(virt_to_page(pbd));
+
+	smp_wmb();
+}
+
+static void prb_close_block(struct tpacket_kbdq_core *pkc,
+		struct tpacket_block_desc *pbd,
+		struct packet_sock *po, unsigned int stat)
+{
+	__u32 status = TP_STATUS_USER | stat;
+	struct tpacket3_hdr *last_pkt;
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+
+	if (po->stats.tp_drops)
+		status |= TP_STATUS_LOSING;
+
+	last_pkt = (struct tpacket3_hdr *)pkc->prev;
+	last_pkt->tp_next_offset = 0;
+
+	if (BLOCK_NUM_PKTS(pbd)) {
+		h1->ts_last_pkt.ts_sec = last_pkt->tp_sec;
+		h1->ts_last_pkt.ts_nsec = last_pkt->tp_nsec;
+	} else {
+		/* The block timed out empty, use the current time */
+		struct timespec ts;
+
+		getnstimeofday(&ts);
+		h1->ts_last_pkt.ts_sec = ts.tv_sec;
+		h1->ts_last_pkt.ts_nsec = ts.tv_nsec;
+	}
+
+	smp_wmb();
+
+	prb_flush_block(pkc, pbd, status);
+
+	pkc->kactive_blk_num = GET_NEXT_PRB_BLK_NUM(pkc);
+
+	po->sk.sk_data_ready(&po->sk, 0);
+}
+
+static inline int prb_curr_blk_in_use(struct tpacket_kbdq_core *pkc,
+		struct tpacket_block_desc *pbd)
+{
+	return TP_STATUS_USER & prb_block_status(pbd);
+}
+
+static inline int prb_queue_frozen(struct tpacket_kbdq_core *pkc)
+{
+	return pkc->reset_pending_on_curr_blk;
+}
+
+static void prb_freeze_queue(struct tpacket_kbdq_core *pkc,
+		struct packet_sock *po)
+{
+	pkc->reset_pending_on_curr_blk = 1;
+	po->tp_freeze_q_cnt++;
+}
+
+/*
+ * Open the next block if user space has released it, and return where
+ * the first packet goes.  Otherwise freeze the queue and return NULL.
+ */
+static char *prb_dispatch_next_block(struct tpacket_kbdq_core *pkc,
+		struct packet_sock *po)
+{
+	struct tpacket_block_desc *pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+
+	if (prb_curr_blk_in_use(pkc, pbd)) {
+		prb_freeze_queue(pkc, po);
+		return NULL;
+	}
+
+	prb_open_block(pkc, pbd);
+	return pkc->nxt_offset;
+}
+
+static void prb_retire_current_block(struct tpacket_kbdq_core *pkc,
+		struct packet_sock *po, unsigned int status)
+{
+	struct tpacket_block_desc *pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+
+	/*
+	 * Another CPU may still be copying a packet into this block
+	 * outside the lock; wait for it before handing the block over.
+	 */
+	while (atomic_read(&pkc->blk_fill_in_prog))
+		cpu_relax();
+
+	prb_close_block(pkc, pbd, po, status);
+}
+
+static void prb_retire_rx_blk_timer_expired(unsigned long data)
+{
+	struct packet_sock *po = (struct packet_sock *)data;
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	struct tpacket_block_desc *pbd;
+
+	spin_lock(&po->sk.sk_receive_queue.lock);
+
+	if (unlikely(pkc->delete_blk_timer))
+		goto out;
+
+	pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+
+	/* A packet is being copied into the block, try again later */
+	if (atomic_read(&pkc->blk_fill_in_prog))
+		goto refresh;
+
+	if (pkc->last_kactive_blk_num == pkc->kactive_blk_num) {
+		if (!prb_queue_frozen(pkc)) {
+			/* An empty block, nothing to hand over */
+			if (!BLOCK_NUM_PKTS(pbd))
+				goto refresh;
+
+			prb_retire_current_block(pkc, po, TP_STATUS_BLK_TMO);
+			if (!prb_dispatch_next_block(pkc, po))
+				goto refresh;
+			goto out;
+		}
+
+		/* Frozen, and user space still holds the block */
+		if (prb_curr_blk_in_use(pkc, pbd))
+			goto refresh;
+
+		/*
+		 * User space caught up while the link was idle; open the
+		 * block, which thaws the queue and restarts the timer.
+		 */
+		prb_open_block(pkc, pbd);
+		goto out;
+	}
+
+refresh:
+	_prb_refresh_rx_retire_blk_timer(pkc);
+out:
+	spin_unlock(&po->sk.sk_receive_queue.lock);
+}
+
+static void prb_fill_curr_block(char *curr, struct tpacket_kbdq_core *pkc,
+		struct tpacket_block_desc *pbd, unsigned int len)
+{
+	struct tpacket3_hdr *ppd = (struct tpacket3_hdr *)curr;
+
+	ppd->tp_next_offset = TOTAL_PKT_LEN_INCL_ALIGN(len);
+	pkc->prev = curr;
+	pkc->nxt_offset += TOTAL_PKT_LEN_INCL_ALIGN(len);
+	BLOCK_LEN(pbd) += TOTAL_PKT_LEN_INCL_ALIGN(len);
+	BLOCK_NUM_PKTS(pbd) += 1;
+	atomic_inc(&pkc->blk_fill_in_prog);
+}
+
+static inline void prb_clear_blk_fill_status(struct packet_ring_buffer *rb)
+{
+	atomic_dec(&GET_PBDQC_FROM_RB(rb)->blk_fill_in_prog);
+}
+
+/* Reserve len bytes for a packet in the current block */
+static char *__packet_lookup_frame_in_block(struct packet_sock *po,
+		unsigned int len)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	struct tpacket_block_desc *pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+	char *curr, *end;
+
+	if (prb_queue_frozen(pkc)) {
+		/* User space still holds the block that froze the queue */
+		if (prb_curr_blk_in_use(pkc, pbd))
+			return NULL;
+		prb_open_block(pkc, pbd);
+	}
+
+	smp_mb();
+	curr = pkc->nxt_offset;
+	end = (char *)pbd + pkc->kblk_size;
+
+	if (curr + TOTAL_PKT_LEN_INCL_ALIGN(len) < end) {
+		prb_fill_curr_block(curr, pkc, pbd, len);
+		return curr;
+	}
+
+	/* The current block is full, close it and try the next one */
+	prb_retire_current_block(pkc, po, 0);
+
+	curr = prb_dispatch_next_block(pkc, po);
+	if (curr) {
+		pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+		prb_fill_curr_block(curr, pkc, pbd, len);
+		return curr;
+	}
+
+	/* No free block, user space is lagging behind: drop */
+	return NULL;
+}
+
+static unsigned int prb_previous_blk_num(struct packet_ring_buffer *rb)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(rb);
+
+	return pkc->kactive_blk_num ? pkc->kactive_blk_num - 1 :
+				      pkc->knum_blocks - 1;
+}
+
+/* Does the last block handed to user space still await processing? */
+static int prb_previous_blk_in_use(struct packet_ring_buffer *rb)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(rb);
+
+	return prb_curr_blk_in_use(pkc,
+			GET_PBLOCK_DESC(pkc, prb_previous_blk_num(rb)));
+}
+
 #endif
 
 static inline struct packet_sock *pkt_sk(struct sock *sk)
@@ -519,7 +899,7 @@ static inline unsigned int run_filter(struct sk_buff *skb, struct sock *sk,
 	rcu_read_lock_bh();
 	filter = rcu_dereference(sk->sk_filter);
 	if (filter != NULL)
-		res = sk_run_filter(skb, filter->insns, filter->len);
+		res = SK_RUN_FILTER(filter, skb);
 	rcu_read_unlock_bh();
 
 	return res;
@@ -656,6 +1036,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 	u8 * skb_head = skb->data;
@@ -707,7 +1088,18 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 		macoff = netoff - maclen;
 	}
 
-	if (macoff + snaplen > po->rx_ring.frame_size) {
+	if (po->tp_version == TPACKET_V3) {
+		unsigned int max_len =
+			GET_PBDQC_FROM_RB(&po->rx_ring)->max_frame_len;
+
+		if (macoff + snaplen > max_len) {
+			snaplen = max_len - macoff;
+			if ((int)snaplen < 0) {
+				snaplen = 0;
+				macoff = max_len;
+			}
+		}
+	} else if (macoff + snaplen > po->rx_ring.frame_size) {
 		if (po->copy_thresh &&
 		    atomic_read(&sk->sk_rmem_alloc) + skb->truesize <
 		    (unsigned)sk->sk_rcvbuf) {
@@ -726,10 +1118,17 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	}
 
 	spin_lock(&sk->sk_receive_queue.lock);
-	h.raw = packet_current_frame(po, &po->rx_ring, TP_STATUS_KERNEL);
-	if (!h.raw)
-		goto ring_is_full;
-	packet_increment_head(&po->rx_ring);
+	if (po->tp_version == TPACKET_V3) {
+		h.raw = __packet_lookup_frame_in_block(po, macoff + snaplen);
+		if (!h.raw)
+			goto ring_is_full;
+	} else {
+		h.raw = packet_current_frame(po, &po->rx_ring,
+					     TP_STATUS_KERNEL);
+		if (!h.raw)
+			goto ring_is_full;
+		packet_increment_head(&po->rx_ring);
+	}
 	po->stats.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
@@ -769,6 +1168,22 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 		h.h2->tp_vlan_tci = skb->vlan_tci;
 		hdrlen = sizeof(*h.h2);
 		break;
+	case TPACKET_V3:
+		h.h3->tp_status = status;
+		h.h3->tp_len = skb->len;
+		h.h3->tp_snaplen = snaplen;
+		h.h3->tp_mac = macoff;
+		h.h3->tp_net = netoff;
+		if (skb->tstamp.tv64)
+			ts = ktime_to_timespec(skb->tstamp);
+		else
+			getnstimeofday(&ts);
+		h.h3->tp_sec = ts.tv_sec;
+		h.h3->tp_nsec = ts.tv_nsec;
+		h.h3->hv1.tp_rxhash = 0;
+		h.h3->hv1.tp_vlan_tci = skb->vlan_tci;
+		hdrlen = sizeof(*h.h3);
+		break;
 	default:
 		BUG();
 	}
@@ -784,6 +1199,13 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	else
 		sll->sll_ifindex = dev->ifindex;
 
+	if (po->tp_version == TPACKET_V3) {
+		/* The block is flushed and user space woken when it closes */
+		smp_wmb();
+		prb_clear_blk_fill_status(&po->rx_ring);
+		goto drop_n_restore;
+	}
+
 	__packet_set_status(po, h.raw, status);
 	smp_mb();
 	{
@@ -1175,7 +1597,7 @@ static int packet_release(struct socket *sock)
 	struct packet_sock *po;
 	struct net *net;
 #ifdef CONFIG_PACKET_MMAP
-	struct tpacket_req req;
+	union tpacket_req_u req_u;
 #endif
 
 	if (!sk)
@@ -1206,13 +1628,13 @@ static int packet_release(struct socket *sock)
 	packet_flush_mclist(sk);
 
 #ifdef CONFIG_PACKET_MMAP
-	memset(&req, 0, sizeof(req));
+	memset(&req_u, 0, sizeof(req_u));
 
 	if (po->rx_ring.pg_vec)
-		packet_set_ring(sk, &req, 1, 0);
+		packet_set_ring(sk, &req_u, 1, 0);
 
 	if (po->tx_ring.pg_vec)
-		packet_set_ring(sk, &req, 1, 1);
+		packet_set_ring(sk, &req_u, 1, 1);
 #endif
 
 	/*
@@ -1738,13 +2160,25 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 	case PACKET_RX_RING:
 	case PACKET_TX_RING:
 	{
-		struct tpacket_req req;
+		union tpacket_req_u req_u;
+		int len;
 
-		if (optlen<sizeof(req))
+		switch (po->tp_version) {
+		case TPACKET_V1:
+		case TPACKET_V2:
+			len = sizeof(req_u.req);
+			break;
+		case TPACKET_V3:
+		default:
+			len = sizeof(req_u.req3);
+			break;
+		}
+		if (optlen < len)
 			return -EINVAL;
-		if (copy_from_user(&req,optval,sizeof(req)))
+		if (copy_from_user(&req_u.req, optval, len))
 			return -EFAULT;
-		return packet_set_ring(sk, &req, 0, optname == PACKET_TX_RING);
+		return packet_set_ring(sk, &req_u, 0,
+				       optname == PACKET_TX_RING);
 	}
 	case PACKET_COPY_THRESH:
 	{
@@ -1771,6 +2205,7 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		switch (val) {
 		case TPACKET_V1:
 		case TPACKET_V2:
+		case TPACKET_V3:
 			po->tp_version = val;
 			return 0;
 		default:
@@ -1841,7 +2276,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 	void *data;
-	struct tpacket_stats st;
+	union tpacket_stats_u st;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -1854,13 +2289,27 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 
 	switch (optname) {
 	case PACKET_STATISTICS:
-		if (len > sizeof(struct tpacket_stats))
-			len = sizeof(struct tpacket_stats);
+		memset(&st, 0, sizeof(st));
 		spin_lock_bh(&sk->sk_receive_queue.lock);
-		st = po->stats;
-		memset(&po->stats, 0, sizeof(st));
+		st.stats1 = po->stats;
+		memset(&po->stats, 0, sizeof(po->stats));
+#ifdef CONFIG_PACKET_MMAP
+		if (po->tp_version == TPACKET_V3) {
+			st.stats3.tp_freeze_q_cnt = po->tp_freeze_q_cnt;
+			po->tp_freeze_q_cnt = 0;
+		}
+#endif
 		spin_unlock_bh(&sk->sk_receive_queue.lock);
-		st.tp_packets += st.tp_drops;
+		st.stats1.tp_packets += st.stats1.tp_drops;
+
+#ifdef CONFIG_PACKET_MMAP
+		if (po->tp_version == TPACKET_V3) {
+			if (len > sizeof(struct tpacket_stats_v3))
+				len = sizeof(struct tpacket_stats_v3);
+		} else
+#endif
+		if (len > sizeof(struct tpacket_stats))
+			len = sizeof(struct tpacket_stats);
 
 		data = &st;
 		break;
@@ -1897,6 +2346,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		case TPACKET_V2:
 			val = sizeof(struct tpacket2_hdr);
 			break;
+		case TPACKET_V3:
+			val = sizeof(struct tpacket3_hdr);
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -2048,7 +2500,11 @@ static unsigned int packet_poll(struct file * file, struct socket *sock,
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
 	if (po->rx_ring.pg_vec) {
-		if (!packet_previous_frame(po, &po->rx_ring, TP_STATUS_KERNEL))
+		if (po->tp_version == TPACKET_V3) {
+			if (prb_previous_blk_in_use(&po->rx_ring))
+				mask |= POLLIN | POLLRDNORM;
+		} else if (!packet_previous_frame(po, &po->rx_ring,
+						  TP_STATUS_KERNEL))
 			mask |= POLLIN | POLLRDNORM;
 	}
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
@@ -2134,7 +2590,7 @@ out_free_pgvec:
 	goto out;
 }
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		int closing, int tx_ring)
 {
 	char **pg_vec = NULL;
@@ -2142,6 +2598,7 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 	int was_running, order = 0;
 	struct packet_ring_buffer *rb;
 	struct sk_buff_head *rb_queue;
+	struct tpacket_req *req = &req_u->req;
 	__be16 num;
 	int err;
 
@@ -2169,6 +2626,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 		case TPACKET_V2:
 			po->tp_hdrlen = TPACKET2_HDRLEN;
 			break;
+		case TPACKET_V3:
+			po->tp_hdrlen = TPACKET3_HDRLEN;
+			break;
 		}
 
 		err = -EINVAL;
@@ -2176,6 +2636,18 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 			goto out;
 		if (unlikely(req->tp_block_size & (PAGE_SIZE - 1)))
 			goto out;
+		if (po->tp_version == TPACKET_V3) {
+			/* Block based rings are for receive only */
+			if (unlikely(tx_ring))
+				goto out;
+			if (unlikely(req_u->req3.tp_sizeof_priv >=
+				     req->tp_block_size))
+				goto out;
+			if (unlikely(BLK_PLUS_PRIV(req_u->req3.tp_sizeof_priv) +
+				     V3_ALIGNMENT + po->tp_hdrlen +
+				     po->tp_reserve > req->tp_block_size))
+				goto out;
+		}
 		if (unlikely(req->tp_frame_size < po->tp_hdrlen +
 					po->tp_reserve))
 			goto out;
@@ -2223,6 +2695,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 	if (closing || atomic_read(&po->mapped) == 0) {
 		err = 0;
 #define XC(a, b) ({ __typeof__ ((a)) __t; __t = (a); (a) = (b); __t; })
+		/* Stop the block retire timer of the old TPACKET_V3 ring */
+		if (!tx_ring && po->tp_version == TPACKET_V3 && rb->pg_vec)
+			prb_shutdown_retire_blk_timer(po, rb_queue);
 		spin_lock_bh(&rb_queue->lock);
 		pg_vec = XC(rb->pg_vec, pg_vec);
 		rb->frame_max = (req->tp_frame_nr - 1);
@@ -2230,6 +2705,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 		rb->frame_size = req->tp_frame_size;
 		spin_unlock_bh(&rb_queue->lock);
 
+		if (!tx_ring && po->tp_version == TPACKET_V3 && rb->pg_vec)
+			init_prb_bdqc(po, rb, rb->pg_vec, req_u);
+
 		order = XC(rb->pg_vec_order, order);
 		req->tp_block_nr = XC(rb->pg_vec_len, req->tp_block_nr);
 
@@ -35,12 +35,17 @@
  * - enqueue, dequeue are serialized via qdisc root lock
  * - ingress filtering is also serialized via qdisc root lock
  * - updates to tree and tree walking are only done under the rtnl mutex.
+ *
+ * The exception are TCQ_F_NOLOCK qdiscs (the default pfifo_fast), which
+ * are enqueued to without any lock and dequeued from only by the CPU
+ * owning __QDISC_STATE_RUNNING, so senders on different CPUs do not
+ * bounce the root lock between them.
  */
 
-static inline int qdisc_qlen(struct Qdisc *q)
-{
-	return q->q.qlen;
-}
+/* Maximum number of packets a lockless qdisc hands to the driver per
+ * HARD_TX_LOCK acquisition.
+ */
+#define QDISC_BULK_DEQUEUE	8
 
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
@@ -61,7 +66,7 @@ static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
 
 		/* check the reason of requeuing without tx lock first */
 		txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
-		if (!netif_tx_queue_stopped(txq) && !netif_tx_queue_frozen(txq))
+		if (!netif_xmit_stopped(txq) && !netif_tx_queue_frozen(txq))
 			q->gso_skb = NULL;
 		else
 			skb = NULL;
@@ -103,7 +108,8 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 }
 
 /*
- * NOTE: Called under qdisc_lock(q) with locally disabled BH.
+ * NOTE: Called under qdisc_lock(q) with locally disabled BH, or just with
+ * locally disabled BH for TCQ_F_NOLOCK qdiscs.
  *
  * __QDISC_STATE_RUNNING guarantees only one CPU can process
  * this qdisc at a time. qdisc_lock(q) serializes queue accesses for
@@ -123,11 +129,13 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
  */
 static inline int qdisc_restart(struct Qdisc *q)
 {
+	int nolock = q->flags & TCQ_F_NOLOCK;
+	int bulk = nolock ? QDISC_BULK_DEQUEUE - 1 : 0;
 	struct netdev_queue *txq;
-	int ret = NETDEV_TX_BUSY;
 	struct net_device *dev;
 	spinlock_t *root_lock;
 	struct sk_buff *skb;
+	int ret;
 
 	/* Dequeue packet */
 	if (unlikely((skb = dequeue_skb(q)) == NULL))
@@ -136,18 +144,34 @@ static inline int qdisc_restart(struct Qdisc *q)
 	root_lock = qdisc_lock(q);
 
 	/* And release qdisc */
-	spin_unlock(root_lock);
+	if (!nolock)
+		spin_unlock(root_lock);
 
 	dev = qdisc_dev(q);
 	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
+	/*
+	 * A lockless qdisc can be dequeued from without the root lock, so
+	 * keep feeding the driver while we hold its lock anyway.  All its
+	 * packets were queued to this txq by dev_queue_xmit().
+	 */
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
-	if (!netif_tx_queue_stopped(txq) &&
-	    !netif_tx_queue_frozen(txq))
+	for (;;) {
+		ret = NETDEV_TX_BUSY;
+		if (netif_xmit_stopped(txq) ||
+		    netif_tx_queue_frozen(txq))
+			break;
 		ret = dev_hard_start_xmit(skb, dev, txq);
+		if (ret != NETDEV_TX_OK || !bulk--)
+			break;
+		skb = q->dequeue(q);
+		if (!skb)
+			break;
+	}
 	HARD_TX_UNLOCK(dev, txq);
 
-	spin_lock(root_lock);
+	if (!nolock)
+		spin_lock(root_lock);
 
 	switch (ret) {
 	case NETDEV_TX_OK:
@@ -164,13 +188,13 @@ static inline int qdisc_restart(struct Qdisc *q)
 		/* Driver returned NETDEV_TX_BUSY - requeue skb */
 		if (unlikely (ret != NETDEV_TX_BUSY && net_ratelimit()))
 			printk(KERN_WARNING "BUG %s code %d qlen %d\n",
-			       dev->name, ret, q->q.qlen);
+			       dev->name, ret, qdisc_qlen(q));
 
 		ret = dev_requeue_skb(skb, q);
 		break;
 	}
 
-	if (ret && (netif_tx_queue_stopped(txq) ||
+	if (ret && (netif_xmit_stopped(txq) ||
 		    netif_tx_queue_frozen(txq)))
 		ret = 0;
 
@@ -181,6 +205,7 @@ void __qdisc_run(struct Qdisc *q)
 {
 	unsigned long start_time = jiffies;
 
+again:
 	while (qdisc_restart(q)) {
 		/*
 		 * Postpone processing if
@@ -189,11 +214,28 @@ void __qdisc_run(struct Qdisc *q)
 		 */
 		if (need_resched() || jiffies != start_time) {
 			__netif_schedule(q);
-			break;
+			clear_bit(__QDISC_STATE_RUNNING, &q->state);
+			return;
 		}
 	}
 
 	clear_bit(__QDISC_STATE_RUNNING, &q->state);
+
+	/*
+	 * Senders of a lockless qdisc enqueue and then try to take
+	 * __QDISC_STATE_RUNNING.  One that lost the race against us after
+	 * our last dequeue relies on us to notice its packet, unless the
+	 * qdisc is already scheduled or the driver will wake it up.
+	 */
+	if (q->flags & TCQ_F_NOLOCK) {
+		smp_mb__after_clear_bit();
+		if (qdisc_qlen(q) &&
+		    !test_bit(__QDISC_STATE_SCHED, &q->state) &&
+		    !netif_xmit_stopped(q->dev_queue) &&
+		    !netif_tx_queue_frozen(q->dev_queue) &&
+		    !test_and_set_bit(__QDISC_STATE_RUNNING, &q->state))
+			goto again;
+	}
 }
 
 unsigned long dev_trans_start(struct net_device *dev)
@@ -387,39 +429,96 @@ static const u8 prio2band[TC_PRIO_MAX+1] =
 
 /* 3-band FIFO queue: old style, but should be a bit faster than
    generic prio+fifo combination.
+
+   It is only used as the root qdisc of a tx queue and runs lockless
+   (TCQ_F_NOLOCK): senders push packets onto a per-band LIFO with
+   cmpxchg(), and the dequeuing CPU (the owner of __QDISC_STATE_RUNNING)
+   takes a whole LIFO at once and turns it into its private FIFO.
  */
 
 #define PFIFO_FAST_BANDS 3
 
-static inline struct sk_buff_head *prio2list(struct sk_buff *skb,
-					     struct Qdisc *qdisc)
+struct pfifo_fast_band {
+	struct sk_buff		*pending;	/* newest first, lockless */
+	atomic_t		count;		/* packets in pending + list */
+	struct sk_buff_head	list;		/* dequeuer only */
+};
+
+struct pfifo_fast_priv {
+	struct pfifo_fast_band	band[PFIFO_FAST_BANDS];
+	atomic_t		backlog;
+	atomic_t		drops;
+};
+
+static inline struct pfifo_fast_band *prio2list(struct sk_buff *skb,
+						struct Qdisc *qdisc)
 {
-	struct sk_buff_head *list = qdisc_priv(qdisc);
-	return list + prio2band[skb->priority & TC_PRIO_MAX];
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	return priv->band + prio2band[skb->priority & TC_PRIO_MAX];
 }
 
 static int pfifo_fast_enqueue(struct sk_buff *skb, struct Qdisc* qdisc)
 {
-	struct sk_buff_head *list = prio2list(skb, qdisc);
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct pfifo_fast_band *band = prio2list(skb, qdisc);
+	struct sk_buff *head;
 
-	if (skb_queue_len(list) < qdisc_dev(qdisc)->tx_queue_len) {
-		qdisc->q.qlen++;
-		return __qdisc_enqueue_tail(skb, qdisc, list);
+	if (atomic_inc_return(&band->count) > qdisc_dev(qdisc)->tx_queue_len) {
+		atomic_dec(&band->count);
+		atomic_inc(&priv->drops);
+		kfree_skb(skb);
+		return NET_XMIT_DROP;
 	}
 
-	return qdisc_drop(skb, qdisc);
+	atomic_add(qdisc_pkt_len(skb), &priv->backlog);
+	do {
+		head = band->pending;
+		skb->next = head;
+	} while (cmpxchg(&band->pending, head, skb) != head);
+
+	/* Must follow the cmpxchg(), see __qdisc_run() */
+	atomic_inc(&qdisc->nolock_qlen);
+
+	return NET_XMIT_SUCCESS;
+}
+
+/* Move the pending packets of a band to its (empty) private list. */
+static int pfifo_fast_splice(struct pfifo_fast_band *band)
+{
+	struct sk_buff *skb, *next;
+
+	if (!band->pending)
+		return 0;
+
+	/* Inserting newest first at the head restores arrival order. */
+	skb = xchg(&band->pending, NULL);
+	while (skb) {
+		next = skb->next;
+		__skb_queue_head(&band->list, skb);
+		skb = next;
+	}
+	return 1;
 }
 
 static struct sk_buff *pfifo_fast_dequeue(struct Qdisc* qdisc)
 {
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct pfifo_fast_band *band;
+	struct sk_buff *skb;
 	int prio;
-	struct sk_buff_head *list = qdisc_priv(qdisc);
 
 	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++) {
-		if (!skb_queue_empty(list + prio)) {
-			qdisc->q.qlen--;
-			return __qdisc_dequeue_head(qdisc, list + prio);
-		}
+		band = priv->band + prio;
+		if (skb_queue_empty(&band->list) && !pfifo_fast_splice(band))
+			continue;
+
+		skb = __skb_dequeue(&band->list);
+		atomic_dec(&band->count);
+		atomic_dec(&qdisc->nolock_qlen);
+		atomic_sub(qdisc_pkt_len(skb), &priv->backlog);
+		qdisc->bstats.bytes += qdisc_pkt_len(skb);
+		qdisc->bstats.packets++;
+		return skb;
 	}
 
 	return NULL;
@@ -427,33 +526,48 @@ static struct sk_buff *pfifo_fast_dequeue(struct Qdisc* qdisc)
 
 static struct sk_buff *pfifo_fast_peek(struct Qdisc* qdisc)
 {
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct pfifo_fast_band *band;
 	int prio;
-	struct sk_buff_head *list = qdisc_priv(qdisc);
 
 	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++) {
-		if (!skb_queue_empty(list + prio))
-			return skb_peek(list + prio);
+		band = priv->band + prio;
+		if (!skb_queue_empty(&band->list) || pfifo_fast_splice(band))
+			return skb_peek(&band->list);
 	}
 
 	return NULL;
 }
 
+/* Caller must make sure that nobody is enqueueing or dequeueing. */
 static void pfifo_fast_reset(struct Qdisc* qdisc)
 {
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct pfifo_fast_band *band;
 	int prio;
-	struct sk_buff_head *list = qdisc_priv(qdisc);
 
-	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		__qdisc_reset_queue(qdisc, list + prio);
+	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++) {
+		band = priv->band + prio;
+		pfifo_fast_splice(band);
+		__skb_queue_purge(&band->list);
+		atomic_set(&band->count, 0);
+	}
 
+	atomic_set(&priv->backlog, 0);
+	atomic_set(&qdisc->nolock_qlen, 0);
 	qdisc->qstats.backlog = 0;
 	qdisc->q.qlen = 0;
 }
 
 static int pfifo_fast_dump(struct Qdisc *qdisc, struct sk_buff *skb)
 {
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
 	struct tc_prio_qopt opt = { .bands = PFIFO_FAST_BANDS };
 
+	/* Fold the lockless counters into the stats about to be dumped */
+	qdisc->qstats.backlog = atomic_read(&priv->backlog);
+	qdisc->qstats.drops = atomic_read(&priv->drops);
+
 	memcpy(&opt.priomap, prio2band, TC_PRIO_MAX+1);
 	NLA_PUT(skb, TCA_OPTIONS, sizeof(opt), &opt);
 	return skb->len;
@@ -464,18 +578,19 @@ nla_put_failure:
 
 static int pfifo_fast_init(struct Qdisc *qdisc, struct nlattr *opt)
 {
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
 	int prio;
-	struct sk_buff_head *list = qdisc_priv(qdisc);
 
 	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		skb_queue_head_init(list + prio);
+		skb_queue_head_init(&priv->band[prio].list);
 
+	qdisc->flags |= TCQ_F_NOLOCK;
 	return 0;
 }
 
 static struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 	.id		=	"pfifo_fast",
-	.priv_size	=	PFIFO_FAST_BANDS * sizeof(struct sk_buff_head),
+	.priv_size	=	sizeof(struct pfifo_fast_priv),
 	.enqueue	=	pfifo_fast_enqueue,
 	.dequeue	=	pfifo_fast_dequeue,
 	.peek		=	pfifo_fast_peek,
@@ -670,8 +785,23 @@ static void dev_deactivate_queue(struct net_device *dev,
 			set_bit(__QDISC_STATE_DEACTIVATED, &qdisc->state);
 
 		rcu_assign_pointer(dev_queue->qdisc, qdisc_default);
-		qdisc_reset(qdisc);
+		/* Lockless qdiscs may still be in use, see dev_deactivate() */
+		if (!(qdisc->flags & TCQ_F_NOLOCK))
+			qdisc_reset(qdisc);
+
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+}
 
+static void dev_reset_nolock_queue(struct net_device *dev,
+				   struct netdev_queue *dev_queue,
+				   void *_unused)
+{
+	struct Qdisc *qdisc = dev_queue->qdisc_sleeping;
+
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		spin_lock_bh(qdisc_lock(qdisc));
+		qdisc_reset(qdisc);
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 }
@@ -716,6 +846,9 @@ void dev_deactivate(struct net_device *dev)
 	/* Wait for outstanding qdisc_run calls. */
 	while (some_qdisc_is_busy(dev))
 		yield();
+
+	/* Now nobody can enqueue to or dequeue from lockless qdiscs. */
+	netdev_for_each_tx_queue(dev, dev_reset_nolock_queue, NULL);
 }
 
 static void dev_init_scheduler_queue(struct net_device *dev,
@@ -5,7 +5,7 @@
  * This software may be used and distributed according to the terms
  * of the GNU General Public License, incorporated herein by reference.
  *
- * Usage: nm -n vmlinux | scripts/kallsyms [--all-symbols] > symbols.S
+ * Usage: nm -n vmlinux | scripts/kallsyms [--all-symbols] [--name-index] > symbols.S
  *
  *      Table compression uses all the unused char codes on the symbols and
  *  maps these to the most used substrings (tokens). For instance, it might
@@ -54,6 +54,7 @@ static struct text_range text_ranges[] = {
 static struct sym_entry *table;
 static unsigned int table_size, table_cnt;
 static int all_symbols = 0;
+static int name_index = 0;
 static char symbol_prefix_char = '\0';
 
 int token_profit[0x10000];
@@ -65,7 +66,7 @@ unsigned char best_table_len[256];
 
 static void usage(void)
 {
-	fprintf(stderr, "Usage: kallsyms [--all-symbols] [--symbol-prefix=<prefix char>] < in.map > out.S\n");
+	fprintf(stderr, "Usage: kallsyms [--all-symbols] [--name-index] [--symbol-prefix=<prefix char>] < in.map > out.S\n");
 	exit(1);
 }
 
@@ -188,6 +189,7 @@ static int symbol_valid(struct sym_entry *s)
 		"kallsyms_markers",
 		"kallsyms_token_table",
 		"kallsyms_token_index",
+		"kallsyms_seqs_of_names",
 
 	/* Exclude linker generated symbols which vary between passes */
 		"_SDA_BASE_",		/* ppc */
@@ -287,6 +289,72 @@ static int expand_symbol(unsigned char *data, int len, char *result)
 	return total;
 }
 
+static char **sorted_names;
+
+static int compare_names(const void *a, const void *b)
+{
+	unsigned int ia = *(const unsigned int *)a;
+	unsigned int ib = *(const unsigned int *)b;
+	int ret;
+
+	/* skip the type char, it is not part of the name */
+	ret = strcmp(sorted_names[ia] + 1, sorted_names[ib] + 1);
+	if (ret)
+		return ret;
+
+	/* keep duplicates in address order, like a linear scan finds them */
+	return ia > ib ? 1 : ia < ib ? -1 : 0;
+}
+
+/*
+ * Output the symbol indexes sorted by name, so that the kernel can binary
+ * search kallsyms by name.  Each index is stored as 3 big-endian bytes.
+ */
+static void write_name_index(void)
+{
+	unsigned int i, *seqs;
+	char buf[KSYM_NAME_LEN];
+
+	sorted_names = malloc(sizeof(char *) * table_cnt);
+	seqs = malloc(sizeof(unsigned int) * table_cnt);
+	if (!sorted_names || !seqs) {
+		fprintf(stderr, "kallsyms failure: "
+			"unable to allocate required memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (table_cnt > 0xFFFFFF) {
+		fprintf(stderr, "kallsyms failure: "
+			"too many symbols for the name index\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < table_cnt; i++) {
+		expand_symbol(table[i].sym, table[i].len, buf);
+		sorted_names[i] = strdup(buf);
+		if (!sorted_names[i]) {
+			fprintf(stderr, "kallsyms failure: "
+				"unable to allocate required memory\n");
+			exit(EXIT_FAILURE);
+		}
+		seqs[i] = i;
+	}
+
+	qsort(seqs, table_cnt, sizeof(unsigned int), compare_names);
+
+	output_label("kallsyms_seqs_of_names");
+	for (i = 0; i < table_cnt; i++)
+		printf("\t.byte 0x%02x, 0x%02x, 0x%02x\n",
+			(seqs[i] >> 16) & 0xFF, (seqs[i] >> 8) & 0xFF,
+			seqs[i] & 0xFF);
+	printf("\n");
+
+	for (i = 0; i < table_cnt; i++)
+		free(sorted_names[i]);
+	free(sorted_names);
+	free(seqs);
+}
+
 static void write_src(void)
 {
 	unsigned int i, k, off;
@@ -376,6 +444,9 @@ static void write_src(void)
 	for (i = 0; i < 256; i++)
 		printf("\t.short\t%d\n", best_idx[i]);
 	printf("\n");
+
+	if (name_index)
+		write_name_index();
 }
 
 
@@ -640,6 +711,8 @@ int main(int argc, char **argv)
 		for (i = 1; i < argc; i++) {
 			if(strcmp(argv[i], "--all-symbols") == 0)
 				all_symbols = 1;
+			else if (strcmp(argv[i], "--name-index") == 0)
+				name_index = 1;
 			else if (strncmp(argv[i], "--symbol-prefix=", 16) == 0) {
 				char *p = &argv[i][16];
 				/* skip quote */
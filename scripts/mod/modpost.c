@@ -244,6 +244,12 @@ static enum export export_no(const char *s)
 	return export_unknown;
 }
 
+static int strstarts(const char *str, const char *prefix)
+{
+	return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+/* In vmlinux the linker has merged the exports into __ksymtab<type> */
 static enum export export_from_sec(struct elf_info *elf, Elf_Section sec)
 {
 	if (sec == elf->export_sec)
@@ -260,6 +266,36 @@ static enum export export_from_sec(struct elf_info *elf, Elf_Section sec)
 		return export_unknown;
 }
 
+/*
+ * In an unlinked object every exported symbol lives in its own
+ * "___ksymtab<type>+<name>" section, so that the linker can sort the
+ * export tables by name.
+ */
+static enum export export_from_secname(struct elf_info *elf, unsigned int sec)
+{
+	const char *secname;
+
+	if (sec == SHN_UNDEF || sec >= SHN_LORESERVE)
+		return export_unknown;
+
+	secname = (void *)elf->hdr +
+		  elf->sechdrs[elf->hdr->e_shstrndx].sh_offset +
+		  elf->sechdrs[sec].sh_name;
+
+	if (strstarts(secname, "___ksymtab+"))
+		return export_plain;
+	else if (strstarts(secname, "___ksymtab_unused+"))
+		return export_unused;
+	else if (strstarts(secname, "___ksymtab_gpl+"))
+		return export_gpl;
+	else if (strstarts(secname, "___ksymtab_unused_gpl+"))
+		return export_unused_gpl;
+	else if (strstarts(secname, "___ksymtab_gpl_future+"))
+		return export_gpl_future;
+	else
+		return export_unknown;
+}
+
 /**
  * Add an exported symbol - it may have already been added without a
  * CRC, in this case just update the CRC
@@ -507,7 +543,12 @@ static void handle_modversions(struct module *mod, struct elf_info *info,
 			       Elf_Sym *sym, const char *symname)
 {
 	unsigned int crc;
-	enum export export = export_from_sec(info, sym->st_shndx);
+	enum export export;
+
+	if (is_vmlinux(mod->name))
+		export = export_from_sec(info, sym->st_shndx);
+	else
+		export = export_from_secname(info, sym->st_shndx);
 
 	switch (sym->st_shndx) {
 	case SHN_COMMON:
@@ -917,7 +958,7 @@ const struct sectioncheck sectioncheck[] = {
 },
 /* Do not export init/exit functions or data */
 {
-	.fromsec = { "__ksymtab*", NULL },
+	.fromsec = { "__ksymtab*", "___ksymtab*", NULL },
 	.tosec   = { INIT_SECTIONS, EXIT_SECTIONS, NULL },
 	.mismatch = EXPORT_TO_INIT_EXIT
 }
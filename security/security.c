@@ -520,6 +520,17 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * MAY_EXEC check for lockless path walks, which may neither sleep nor
+ * look at inode->i_security.  Only the default operations can answer.
+ */
+int security_inode_exec_permission_rcu(struct inode *inode)
+{
+	if (security_ops != &default_security_ops)
+		return -EAGAIN;
+	return 0;
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))